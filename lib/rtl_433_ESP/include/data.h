@@ -49,6 +49,7 @@
 #endif
 
 #include <stddef.h>
+#include <stdint.h>
 
 typedef enum {
   DATA_DATA,   /**< pointer to data is stored */
@@ -75,6 +76,14 @@ typedef union data_value {
   void *v_ptr;  /**< A data value pointer, 4/8 bytes size/alignment */
 } data_value_t;
 
+/** Strings of a data element that are referenced instead of owned. */
+typedef enum {
+  DATA_BORROWED_KEY        = 1 << 0, /**< key points to a literal */
+  DATA_BORROWED_PRETTY_KEY = 1 << 1, /**< pretty_key points to a literal */
+  DATA_BORROWED_FORMAT     = 1 << 2, /**< format points to a literal */
+  DATA_BORROWED_VALUE      = 1 << 3, /**< DATA_STRING value points to a literal */
+} data_borrowed_t;
+
 typedef struct data {
   struct data *next; /**< chaining to the next element in the linked list; NULL
                         indicates end-of-list */
@@ -86,6 +95,7 @@ typedef struct data {
   data_type_t type;
   unsigned retain; /**< incremented on data_retain, data_free only frees if this
                       is zero */
+  unsigned borrowed; /**< data_borrowed_t flags, data_free skips these strings */
 } data_t;
 
 /** Constructs a structured data object.
@@ -100,7 +110,8 @@ typedef struct data {
 
     Most of the time the function copies perhaps what you expect it to. Things
     it copies:
-    - string contents for keys and values
+    - string contents for keys and values, unless they are literals in flash
+      (read only data), those are referenced and flagged in data_t::borrowed
     - numerical arrays
     - string arrays (copied deeply)
 
@@ -158,6 +169,12 @@ R_API data_t *data_retain(data_t *data);
  */
 R_API void data_free(data_t *data);
 
+/** Replaces the key of a data element, takes ownership of the new key. */
+R_API void data_set_key(data_t *data, char *key);
+
+/** Replaces the format of a data element, takes ownership of the new format. */
+R_API void data_set_format(data_t *data, char *format);
+
 struct data_output;
 
 typedef struct data_output {
@@ -205,4 +222,20 @@ R_API void print_array_value(data_output_t *output, data_array_t *array,
 
 R_API size_t data_print_jsons(data_t *data, char *dst, size_t len);
 
+/** Interned keys for the binary encoding, the key index is sent in place of
+    the key text. The list is NULL terminated and must stay in sync with the
+    host decoder (tools/event_decoder.py), only append to it.
+*/
+extern char const *const data_cbor_keys[];
+
+/** Prints a structured data object as a CBOR map into a byte buffer.
+
+    Keys listed in data_cbor_keys are written as small integers, all other keys
+    as text. Doubles that survive a float round trip are written as single
+    precision floats.
+
+    @return number of bytes written or 0 if the buffer was too small.
+*/
+R_API size_t data_print_cbor(data_t *data, uint8_t *dst, size_t len);
+
 #endif // INCLUDE_DATA_H_
@@ -23,6 +23,11 @@
 #define SIGNAL_GRABBER_BUFFER (12 * DEFAULT_BUF_LENGTH)
 #define MAX_FREQS 32
 
+#ifndef DEDUP_WINDOW_MS
+#define DEDUP_WINDOW_MS 1000 // drop exact repeats of a message within this time, 0 to disable
+#endif
+#define DEDUP_CACHE_SIZE 8   // messages remembered for DEDUP_WINDOW_MS
+
 #define INPUT_LINE_MAX                                                         \
   8192 /**< enough for a complete textual bitbuffer (25*256) */
 
@@ -149,6 +154,17 @@ typedef struct r_cfg {
    * publishing.
    */
   void (*callback)(char *message, uint8_t *data, int dataSize);
+
+  uint8_t *eventBuffer; // binary event buffer for event callback
+  int eventBufferSize;  // size of binary event buffer
+
+  /**
+   * optional callback receiving a CBOR encoded copy of each message, see
+   * data_print_cbor().
+   */
+  void (*eventCallback)(uint8_t *event, int eventSize);
+
+  unsigned suppressedRepeats; // repeated messages dropped, see DEDUP_WINDOW_MS
 } r_cfg_t;
 
 #endif /* INCLUDE_RTL_433_H_ */
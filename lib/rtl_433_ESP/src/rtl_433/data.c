@@ -22,10 +22,24 @@
 #include <stdlib.h>
 #include <stdbool.h>
 
+#ifdef ESP32
+#if __has_include("esp_memory_utils.h")
+#include "esp_memory_utils.h"
+#else
+#include "soc/soc_memory_layout.h"
+#endif
+#include "freertos/FreeRTOS.h"
+#endif
+
 // Macro to prevent unused variables (passed into a function)
 // from generating a warning.
 #define UNUSED(x) (void)(x)
 
+// Number of released data_t elements kept for reuse
+#ifndef DATA_ELEMENT_CACHE_SIZE
+#define DATA_ELEMENT_CACHE_SIZE 16
+#endif
+
 typedef void* (*array_elementwise_import_fn)(void*);
 typedef void (*array_element_release_fn)(void*);
 typedef void (*value_release_fn)(void*);
@@ -115,6 +129,80 @@ static bool import_values(void *dst, void const *src, int num_values, data_type_
     return true; // error is returned early
 }
 
+/* literal strings */
+
+/* Keys, pretty keys and formats are almost always string literals, on the
+   ESP32 these live in flash (DROM) for the lifetime of the program and are
+   referenced instead of copied. Everything else is copied as before. */
+static bool is_literal(char const *str)
+{
+#ifdef ESP32
+    return esp_ptr_in_drom(str);
+#else
+    UNUSED(str);
+    return false;
+#endif
+}
+
+static char *borrow_or_strdup(char const *str, unsigned *borrowed, unsigned flag)
+{
+    if (is_literal(str)) {
+        *borrowed |= flag;
+        return (char *)str;
+    }
+    return strdup(str);
+}
+
+static void release_string(char *str, unsigned borrowed, unsigned flag)
+{
+    if (!(borrowed & flag))
+        free(str);
+}
+
+/* element cache */
+
+#ifdef ESP32
+static portMUX_TYPE element_cache_mux = portMUX_INITIALIZER_UNLOCKED;
+#define ELEMENT_CACHE_LOCK()   portENTER_CRITICAL(&element_cache_mux)
+#define ELEMENT_CACHE_UNLOCK() portEXIT_CRITICAL(&element_cache_mux)
+#else
+#define ELEMENT_CACHE_LOCK()
+#define ELEMENT_CACHE_UNLOCK()
+#endif
+
+static data_t *element_cache;
+static int element_cache_len;
+
+static data_t *element_alloc(void)
+{
+    ELEMENT_CACHE_LOCK();
+    data_t *element = element_cache;
+    if (element) {
+        element_cache = element->next;
+        element_cache_len--;
+    }
+    ELEMENT_CACHE_UNLOCK();
+
+    if (!element)
+        return calloc(1, sizeof(data_t));
+    memset(element, 0, sizeof(*element));
+    return element;
+}
+
+static void element_release(data_t *element)
+{
+    ELEMENT_CACHE_LOCK();
+    if (element_cache_len < DATA_ELEMENT_CACHE_SIZE) {
+        element->next = element_cache;
+        element_cache = element;
+        element_cache_len++;
+        element = NULL;
+    }
+    ELEMENT_CACHE_UNLOCK();
+
+    free(element);
+}
+
 /* data */
 
 R_API data_array_t *data_array(int num_values, data_type_t type, void const *values)
@@ -158,6 +246,7 @@ static data_t *vdata_make(data_t *first, const char *key, const char *pretty_key
     while (prev && prev->next)
         prev = prev->next;
     char *format = NULL;
+    unsigned borrowed = 0; // literal strings of the current item
     int skip = 0; // skip the data item if this is set
     type = va_arg(ap, data_type_t);
     do {
@@ -176,7 +265,7 @@ static data_t *vdata_make(data_t *first, const char *key, const char *pretty_key
                 fprintf(stderr, "vdata_make() format type used twice\n");
                 goto alloc_error;
             }
-            format = strdup(va_arg(ap, char *));
+            format = borrow_or_strdup(va_arg(ap, char *), &borrowed, DATA_BORROWED_FORMAT);
             if (!format) {
                 WARN_STRDUP("vdata_make()");
                 goto alloc_error;
@@ -197,10 +286,11 @@ static data_t *vdata_make(data_t *first, const char *key, const char *pretty_key
             value.v_dbl = va_arg(ap, double);
             break;
         case DATA_STRING:
-            value_release = (value_release_fn)free; // appease CSA checker
-            value.v_ptr = strdup(va_arg(ap, char *));
+            value.v_ptr = borrow_or_strdup(va_arg(ap, char *), &borrowed, DATA_BORROWED_VALUE);
             if (!value.v_ptr)
                 WARN_STRDUP("vdata_make()");
+            if (!(borrowed & DATA_BORROWED_VALUE))
+                value_release = (value_release_fn)free; // appease CSA checker
             break;
         case DATA_ARRAY:
             value_release = (value_release_fn)data_array_free; // appease CSA checker
@@ -214,23 +304,26 @@ static data_t *vdata_make(data_t *first, const char *key, const char *pretty_key
         if (skip) {
             if (value_release) // could use dmt[type].value_release
                 value_release(value.v_ptr);
-            free(format);
+            release_string(format, borrowed, DATA_BORROWED_FORMAT);
             format = NULL;
+            borrowed = 0;
             skip = 0;
         }
         else {
-            current = calloc(1, sizeof(*current));
+            current = element_alloc();
             if (!current) {
                 WARN_CALLOC("vdata_make()");
                 if (value_release) // could use dmt[type].value_release
                     value_release(value.v_ptr);
                 goto alloc_error;
             }
-            current->type   = type;
-            current->format = format;
-            format          = NULL; // consumed
-            current->value  = value;
-            current->next   = NULL;
+            current->type     = type;
+            current->format   = format;
+            format            = NULL; // consumed
+            current->value    = value;
+            current->next     = NULL;
+            current->borrowed = borrowed;
+            borrowed          = 0; // consumed
 
             if (prev)
                 prev->next = current;
@@ -238,12 +331,12 @@ static data_t *vdata_make(data_t *first, const char *key, const char *pretty_key
             if (!first)
                 first = current;
 
-            current->key = strdup(key);
+            current->key = borrow_or_strdup(key, &current->borrowed, DATA_BORROWED_KEY);
             if (!current->key) {
                 WARN_STRDUP("vdata_make()");
                 goto alloc_error;
             }
-            current->pretty_key = strdup(pretty_key ? pretty_key : key);
+            current->pretty_key = borrow_or_strdup(pretty_key ? pretty_key : key, &current->borrowed, DATA_BORROWED_PRETTY_KEY);
             if (!current->pretty_key) {
                 WARN_STRDUP("vdata_make()");
                 goto alloc_error;
@@ -266,7 +359,7 @@ static data_t *vdata_make(data_t *first, const char *key, const char *pretty_key
     return first;
 
 alloc_error:
-    free(format); // if not consumed
+    release_string(format, borrowed, DATA_BORROWED_FORMAT); // if not consumed
     data_free(first);
     return NULL;
 }
@@ -334,16 +427,30 @@ R_API void data_free(data_t *data)
     }
     while (data) {
         data_t *prev_data = data;
-        if (dmt[data->type].value_release)
+        if (dmt[data->type].value_release && !(data->borrowed & DATA_BORROWED_VALUE))
             dmt[data->type].value_release(data->value.v_ptr);
-        free(data->format);
-        free(data->pretty_key);
-        free(data->key);
+        release_string(data->format, data->borrowed, DATA_BORROWED_FORMAT);
+        release_string(data->pretty_key, data->borrowed, DATA_BORROWED_PRETTY_KEY);
+        release_string(data->key, data->borrowed, DATA_BORROWED_KEY);
         data = data->next;
-        free(prev_data);
+        element_release(prev_data);
     }
 }
 
+R_API void data_set_key(data_t *data, char *key)
+{
+    release_string(data->key, data->borrowed, DATA_BORROWED_KEY);
+    data->borrowed &= ~DATA_BORROWED_KEY;
+    data->key = key;
+}
+
+R_API void data_set_format(data_t *data, char *format)
+{
+    release_string(data->format, data->borrowed, DATA_BORROWED_FORMAT);
+    data->borrowed &= ~DATA_BORROWED_FORMAT;
+    data->format = format;
+}
+
 /* data output */
 
 R_API void data_output_print(data_output_t *output, data_t *data)
@@ -558,3 +665,199 @@ R_API size_t data_print_jsons(data_t *data, char *dst, size_t len)
 
     return len - jsons.msg.left;
 }
+
+/* CBOR binary printer */
+
+char const *const data_cbor_keys[] = {
+        "model",
+        "type",
+        "id",
+        "flags",
+        "pressure_kPa",
+        "temperature_C",
+        "temperature_F",
+        "mic",
+        "protocol",
+        "rssi",
+        "duration",
+        "battery_ok",
+        "channel",
+        "humidity",
+        "subtype",
+        "status",
+        "state",
+        "code",
+        "button",
+        "pressure_PSI",
+        "moving",
+        "learn",
+        "alarm",
+        NULL,
+};
+
+#define CBOR_UINT   0x00
+#define CBOR_NEGINT 0x20
+#define CBOR_TEXT   0x60
+#define CBOR_ARRAY  0x80
+#define CBOR_MAP    0xa0
+#define CBOR_FLOAT  0xfa
+#define CBOR_DOUBLE 0xfb
+
+typedef struct {
+    struct data_output output;
+    uint8_t *tail;
+    size_t left;
+    bool overflow;
+} data_print_cbor_t;
+
+static void cbor_put(data_print_cbor_t *cbor, uint8_t const *src, size_t len)
+{
+    if (cbor->overflow || cbor->left < len) {
+        cbor->overflow = true;
+        return;
+    }
+    memcpy(cbor->tail, src, len);
+    cbor->tail += len;
+    cbor->left -= len;
+}
+
+static void cbor_head(data_print_cbor_t *cbor, uint8_t major, uint32_t val)
+{
+    uint8_t b[5];
+    size_t n;
+
+    if (val < 24) {
+        b[0] = major | (uint8_t)val;
+        n    = 1;
+    }
+    else if (val <= 0xff) {
+        b[0] = major | 24;
+        b[1] = (uint8_t)val;
+        n    = 2;
+    }
+    else if (val <= 0xffff) {
+        b[0] = major | 25;
+        b[1] = (uint8_t)(val >> 8);
+        b[2] = (uint8_t)val;
+        n    = 3;
+    }
+    else {
+        b[0] = major | 26;
+        b[1] = (uint8_t)(val >> 24);
+        b[2] = (uint8_t)(val >> 16);
+        b[3] = (uint8_t)(val >> 8);
+        b[4] = (uint8_t)val;
+        n    = 5;
+    }
+    cbor_put(cbor, b, n);
+}
+
+static void cbor_text(data_print_cbor_t *cbor, const char *str)
+{
+    size_t str_len = strlen(str);
+    cbor_head(cbor, CBOR_TEXT, (uint32_t)str_len);
+    cbor_put(cbor, (uint8_t const *)str, str_len);
+}
+
+static void cbor_key(data_print_cbor_t *cbor, const char *key)
+{
+    for (int i = 0; data_cbor_keys[i]; ++i) {
+        if (!strcmp(key, data_cbor_keys[i])) {
+            cbor_head(cbor, CBOR_UINT, (uint32_t)i);
+            return;
+        }
+    }
+    cbor_text(cbor, key);
+}
+
+static void R_API_CALLCONV format_cbor_array(data_output_t *output, data_array_t *array, char const *format)
+{
+    data_print_cbor_t *cbor = (data_print_cbor_t *)output;
+
+    cbor_head(cbor, CBOR_ARRAY, (uint32_t)array->num_values);
+    for (int c = 0; c < array->num_values; ++c) {
+        print_array_value(output, array, format, c);
+    }
+}
+
+static void R_API_CALLCONV format_cbor_object(data_output_t *output, data_t *data, char const *format)
+{
+    UNUSED(format);
+    data_print_cbor_t *cbor = (data_print_cbor_t *)output;
+
+    uint32_t num_pairs = 0;
+    for (data_t *d = data; d; d = d->next)
+        ++num_pairs;
+
+    cbor_head(cbor, CBOR_MAP, num_pairs);
+    while (data) {
+        cbor_key(cbor, data->key);
+        print_value(output, data->type, data->value, data->format);
+        data = data->next;
+    }
+}
+
+static void R_API_CALLCONV format_cbor_string(data_output_t *output, const char *str, char const *format)
+{
+    UNUSED(format);
+    cbor_text((data_print_cbor_t *)output, str);
+}
+
+static void R_API_CALLCONV format_cbor_double(data_output_t *output, double data, char const *format)
+{
+    UNUSED(format);
+    data_print_cbor_t *cbor = (data_print_cbor_t *)output;
+    uint8_t b[9];
+
+    // most readings are computed in float, send those as single precision
+    float single = (float)data;
+    if ((double)single == data) {
+        uint32_t bits;
+        memcpy(&bits, &single, sizeof(bits));
+        b[0] = CBOR_FLOAT;
+        for (int i = 0; i < 4; ++i)
+            b[1 + i] = (uint8_t)(bits >> (24 - 8 * i));
+        cbor_put(cbor, b, 5);
+    }
+    else {
+        uint64_t bits;
+        memcpy(&bits, &data, sizeof(bits));
+        b[0] = CBOR_DOUBLE;
+        for (int i = 0; i < 8; ++i)
+            b[1 + i] = (uint8_t)(bits >> (56 - 8 * i));
+        cbor_put(cbor, b, 9);
+    }
+}
+
+static void R_API_CALLCONV format_cbor_int(data_output_t *output, int data, char const *format)
+{
+    UNUSED(format);
+    data_print_cbor_t *cbor = (data_print_cbor_t *)output;
+
+    if (data >= 0)
+        cbor_head(cbor, CBOR_UINT, (uint32_t)data);
+    else
+        cbor_head(cbor, CBOR_NEGINT, (uint32_t)(-1 - data));
+}
+
+R_API size_t data_print_cbor(data_t *data, uint8_t *dst, size_t len)
+{
+    data_print_cbor_t cbor = {
+            .output = {
+                    .print_data   = format_cbor_object,
+                    .print_array  = format_cbor_array,
+                    .print_string = format_cbor_string,
+                    .print_double = format_cbor_double,
+                    .print_int    = format_cbor_int,
+            },
+            .tail     = dst,
+            .left     = len,
+            .overflow = false,
+    };
+
+    format_cbor_object(&cbor.output, data, NULL);
+
+    if (cbor.overflow)
+        return 0;
+    return len - cbor.left;
+}
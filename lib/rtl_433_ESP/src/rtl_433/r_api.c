@@ -26,7 +26,12 @@
 #include "rtl_433.h"
 #include "rtl_433_devices.h"
 // #include "pulse_detect_fsk.h"
-// #include "compat_time.h"
+#include "compat_time.h"
+#ifdef ESP32
+#include "esp_timer.h"
+#else
+#include <time.h>
+#endif
 #include "data.h"
 // #include "data_tag.h"
 #include "fatal.h"
@@ -696,6 +701,93 @@ void r_redirect_logging(r_cfg_t *cfg) {
   r_logger_set_log_handler(log_handler, cfg);
 }
 */
+/* burst deduplication */
+
+/// Hash the keys and values of a message, FNV-1a.
+static uint32_t data_hash(data_t* data, uint32_t hash) {
+  for (data_t* d = data; d; d = d->next) {
+    for (char const* c = d->key; *c; ++c)
+      hash = (hash ^ (uint8_t)*c) * 16777619u;
+
+    switch (d->type) {
+    case DATA_DATA:
+      hash = data_hash(d->value.v_ptr, hash);
+      break;
+    case DATA_INT:
+      hash = (hash ^ (uint32_t)d->value.v_int) * 16777619u;
+      break;
+    case DATA_DOUBLE: {
+      uint8_t const* b = (uint8_t const*)&d->value.v_dbl;
+      for (size_t i = 0; i < sizeof(d->value.v_dbl); ++i)
+        hash = (hash ^ b[i]) * 16777619u;
+      break;
+    }
+    case DATA_STRING:
+      for (char const* c = d->value.v_ptr; *c; ++c)
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+      break;
+    case DATA_ARRAY: {
+      data_array_t* array = d->value.v_ptr;
+      hash = (hash ^ (uint32_t)array->num_values) * 16777619u;
+      for (int i = 0; i < array->num_values; ++i) {
+        if (array->type == DATA_INT)
+          hash = (hash ^ (uint32_t)((int*)array->values)[i]) * 16777619u;
+        else if (array->type == DATA_STRING)
+          for (char const* c = ((char**)array->values)[i]; *c; ++c)
+            hash = (hash ^ (uint8_t)*c) * 16777619u;
+      }
+      break;
+    }
+    default:
+      break;
+    }
+  }
+  return hash;
+}
+
+/// Monotonic milliseconds, the wall clock may be set while running
+static uint32_t dedup_now_ms(void) {
+#ifdef ESP32
+  return (uint32_t)(esp_timer_get_time() / 1000);
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)now.tv_sec * 1000u + (uint32_t)(now.tv_nsec / 1000000);
+#endif
+}
+
+/**
+ * Check if a message is an exact repeat of one seen within DEDUP_WINDOW_MS,
+ * sensors send each message several times per burst.  Remembers the message
+ * otherwise, replacing the oldest entry of the cache.
+ */
+static int is_repeat(r_device* r_dev, data_t* data) {
+  static struct {
+    uint32_t hash;
+    uint32_t seen;
+    unsigned protocol_num;
+  } cache[DEDUP_CACHE_SIZE];
+
+  uint32_t hash = data_hash(data, 2166136261u);
+  uint32_t now = dedup_now_ms();
+  int oldest = 0;
+
+  for (int i = 0; i < DEDUP_CACHE_SIZE; ++i) {
+    if (cache[i].seen && cache[i].hash == hash &&
+        cache[i].protocol_num == r_dev->protocol_num &&
+        now - cache[i].seen < DEDUP_WINDOW_MS) {
+      return 1;
+    }
+    if (now - cache[i].seen > now - cache[oldest].seen)
+      oldest = i;
+  }
+
+  cache[oldest].hash = hash;
+  cache[oldest].seen = now ? now : 1; // 0 marks an unused entry
+  cache[oldest].protocol_num = r_dev->protocol_num;
+  return 0;
+}
+
 /** Pass the data structure to all output handlers. Frees data afterwards. */
 /*
 void event_occurred_handler(r_cfg_t *cfg, data_t *data) {
@@ -743,6 +835,14 @@ void log_device_handler(r_device* r_dev, int level, data_t* data) {
 void data_acquired_handler(r_device* r_dev, data_t* data) {
   r_cfg_t* cfg = r_dev->output_ctx;
 
+#if DEDUP_WINDOW_MS > 0
+  if (is_repeat(r_dev, data)) {
+    cfg->suppressedRepeats++;
+    data_free(data);
+    return;
+  }
+#endif
+
 #ifndef NDEBUG
   // check for undeclared csv fields
   for (data_t* d = data; d; d = d->next) {
@@ -766,32 +866,29 @@ void data_acquired_handler(r_device* r_dev, data_t* data) {
       if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_F")) {
         d->value.v_dbl = fahrenheit2celsius(d->value.v_dbl);
         char* new_label = str_replace(d->key, "_F", "_C");
-        free(d->key);
-        d->key = new_label;
+        data_set_key(d, new_label);
+        char* new_format_label = d->format ? strdup(d->format) : NULL;
         char* pos;
-        if (d->format && (pos = strrchr(d->format, 'F'))) {
+        if (new_format_label && (pos = strrchr(new_format_label, 'F'))) {
           *pos = 'C';
         }
+        data_set_format(d, new_format_label);
       }
       // Convert double type fields ending in _mph to _kph
       else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_mph")) {
         d->value.v_dbl = mph2kmph(d->value.v_dbl);
         char* new_label = str_replace(d->key, "_mph", "_kph");
-        free(d->key);
-        d->key = new_label;
+        data_set_key(d, new_label);
         char* new_format_label = str_replace(d->format, "mi/h", "km/h");
-        free(d->format);
-        d->format = new_format_label;
+        data_set_format(d, new_format_label);
       }
       // Convert double type fields ending in _mi_h to _km_h
       else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_mi_h")) {
         d->value.v_dbl = mph2kmph(d->value.v_dbl);
         char* new_label = str_replace(d->key, "_mi_h", "_km_h");
-        free(d->key);
-        d->key = new_label;
+        data_set_key(d, new_label);
         char* new_format_label = str_replace(d->format, "mi/h", "km/h");
-        free(d->format);
-        d->format = new_format_label;
+        data_set_format(d, new_format_label);
       }
       // Convert double type fields ending in _in to _mm
       else if ((d->type == DATA_DOUBLE) &&
@@ -801,41 +898,33 @@ void data_acquired_handler(r_device* r_dev, data_t* data) {
         char* new_label1 = str_replace(d->key, "_inch", "_in");
         char* new_label2 = str_replace(new_label1, "_in", "_mm");
         free(new_label1);
-        free(d->key);
-        d->key = new_label2;
+        data_set_key(d, new_label2);
         char* new_format_label = str_replace(d->format, "in", "mm");
-        free(d->format);
-        d->format = new_format_label;
+        data_set_format(d, new_format_label);
       }
       // Convert double type fields ending in _in_h to _mm_h
       else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_in_h")) {
         d->value.v_dbl = inch2mm(d->value.v_dbl);
         char* new_label = str_replace(d->key, "_in_h", "_mm_h");
-        free(d->key);
-        d->key = new_label;
+        data_set_key(d, new_label);
         char* new_format_label = str_replace(d->format, "in/h", "mm/h");
-        free(d->format);
-        d->format = new_format_label;
+        data_set_format(d, new_format_label);
       }
       // Convert double type fields ending in _inHg to _hPa
       else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_inHg")) {
         d->value.v_dbl = inhg2hpa(d->value.v_dbl);
         char* new_label = str_replace(d->key, "_inHg", "_hPa");
-        free(d->key);
-        d->key = new_label;
+        data_set_key(d, new_label);
         char* new_format_label = str_replace(d->format, "inHg", "hPa");
-        free(d->format);
-        d->format = new_format_label;
+        data_set_format(d, new_format_label);
       }
       // Convert double type fields ending in _PSI to _kPa
       else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_PSI")) {
         d->value.v_dbl = psi2kpa(d->value.v_dbl);
         char* new_label = str_replace(d->key, "_PSI", "_kPa");
-        free(d->key);
-        d->key = new_label;
+        data_set_key(d, new_label);
         char* new_format_label = str_replace(d->format, "PSI", "kPa");
-        free(d->format);
-        d->format = new_format_label;
+        data_set_format(d, new_format_label);
       }
     }
   }
@@ -845,72 +934,61 @@ void data_acquired_handler(r_device* r_dev, data_t* data) {
       if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_C")) {
         d->value.v_dbl = celsius2fahrenheit(d->value.v_dbl);
         char* new_label = str_replace(d->key, "_C", "_F");
-        free(d->key);
-        d->key = new_label;
+        data_set_key(d, new_label);
+        char* new_format_label = d->format ? strdup(d->format) : NULL;
         char* pos;
-        if (d->format && (pos = strrchr(d->format, 'C'))) {
+        if (new_format_label && (pos = strrchr(new_format_label, 'C'))) {
           *pos = 'F';
         }
+        data_set_format(d, new_format_label);
       }
       // Convert double type fields ending in _kph to _mph
       else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_kph")) {
         d->value.v_dbl = kmph2mph(d->value.v_dbl);
         char* new_label = str_replace(d->key, "_kph", "_mph");
-        free(d->key);
-        d->key = new_label;
+        data_set_key(d, new_label);
         char* new_format_label = str_replace(d->format, "km/h", "mi/h");
-        free(d->format);
-        d->format = new_format_label;
+        data_set_format(d, new_format_label);
       }
       // Convert double type fields ending in _km_h to _mi_h
       else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_km_h")) {
         d->value.v_dbl = kmph2mph(d->value.v_dbl);
         char* new_label = str_replace(d->key, "_km_h", "_mi_h");
-        free(d->key);
-        d->key = new_label;
+        data_set_key(d, new_label);
         char* new_format_label = str_replace(d->format, "km/h", "mi/h");
-        free(d->format);
-        d->format = new_format_label;
+        data_set_format(d, new_format_label);
       }
       // Convert double type fields ending in _mm to _inch
       else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_mm")) {
         d->value.v_dbl = mm2inch(d->value.v_dbl);
         char* new_label = str_replace(d->key, "_mm", "_in");
-        free(d->key);
-        d->key = new_label;
+        data_set_key(d, new_label);
         char* new_format_label = str_replace(d->format, "mm", "in");
-        free(d->format);
-        d->format = new_format_label;
+        data_set_format(d, new_format_label);
       }
       // Convert double type fields ending in _mm_h to _in_h
       else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_mm_h")) {
         d->value.v_dbl = mm2inch(d->value.v_dbl);
         char* new_label = str_replace(d->key, "_mm_h", "_in_h");
-        free(d->key);
-        d->key = new_label;
+        data_set_key(d, new_label);
         char* new_format_label = str_replace(d->format, "mm/h", "in/h");
-        free(d->format);
-        d->format = new_format_label;
+        data_set_format(d, new_format_label);
       }
       // Convert double type fields ending in _hPa to _inHg
       else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_hPa")) {
         d->value.v_dbl = hpa2inhg(d->value.v_dbl);
         char* new_label = str_replace(d->key, "_hPa", "_inHg");
-        free(d->key);
-        d->key = new_label;
+        data_set_key(d, new_label);
         char* new_format_label = str_replace(d->format, "hPa", "inHg");
-        free(d->format);
-        d->format = new_format_label;
+        data_set_format(d, new_format_label);
       }
       // Convert double type fields ending in _kPa to _PSI
       else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_kPa")) {
         d->value.v_dbl = kpa2psi(d->value.v_dbl);
         char* new_label = str_replace(d->key, "_kPa", "_PSI");
-        free(d->key);
-        d->key = new_label;
+        data_set_key(d, new_label);
         char* new_format_label = str_replace(d->format, "kPa", "PSI");
-        free(d->format);
-        d->format = new_format_label;
+        data_set_format(d, new_format_label);
       }
     }
   }
@@ -983,6 +1061,13 @@ void data_acquired_handler(r_device* r_dev, data_t* data) {
   // callback to external function that receives message from device (
   // rtl_433_ESPCallBack )
   (cfg->callback)(cfg->messageBuffer, cfg->dataBuffer, cfg->receivedDataSize);
+
+  if (cfg->eventCallback) {
+    size_t eventSize = data_print_cbor(data, cfg->eventBuffer, cfg->eventBufferSize);
+    if (eventSize > 0) {
+      (cfg->eventCallback)(cfg->eventBuffer, (int)eventSize);
+    }
+  }
   data_free(data);
 }
 
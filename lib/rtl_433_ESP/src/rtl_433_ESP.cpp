@@ -68,12 +68,12 @@ Module* _mod = radio.getMod();
 /**
  * Is the receiver currently receiving a signal
  */
-static bool receiveMode = false;
+static volatile bool receiveMode = false;
 
 /**
  * Timestamp in micros for start of current signal
  */
-static unsigned long signalStart = micros();
+static volatile unsigned long signalStart = micros();
 
 /**
  * Timestamp in micros for end of most recent message aka start of current gap
@@ -84,7 +84,7 @@ static unsigned long gapStart = micros();
  * Timestamp in micros for end of most recent signal
  *
  */
-static unsigned long signalEnd = micros();
+static volatile unsigned long signalEnd = micros();
 
 pulse_data_t* _pulseTrains;
 
@@ -104,6 +104,7 @@ volatile int16_t rtl_433_ESP::_nrpulses;
 int rtl_433_ESP::totalSignals = 0;
 int rtl_433_ESP::ignoredSignals = 0;
 int rtl_433_ESP::unparsedSignals = 0;
+int rtl_433_ESP::abortedSignals = 0;
 int signalRatio = 0;
 
 // RSSI Threshold and average calculation
@@ -113,19 +114,68 @@ int rtl_433_ESP::rssiThresholdDelta = RSSI_THRESHOLD;
 
 bool rtl_433_ESP::ookModulation = OOK_MODULATION; // Defaults to true
 
-int _totalRssi = 0;
+int32_t _noiseFloor = 0; // Noise floor in 1/256 dB
+int32_t _noiseFloorRemainder = 0; // Steps not yet applied, in 1/25600 dB
+bool _noiseFloorValid = false;
+
+static_assert(NOISE_FLOOR_STEP * NOISE_FLOOR_PERCENTILE > 0 &&
+                  NOISE_FLOOR_STEP * (100 - NOISE_FLOOR_PERCENTILE) > 0,
+              "NOISE_FLOOR_STEP must be positive and NOISE_FLOOR_PERCENTILE within 1 to 99");
 int _rssiCount = 0;
 
 int _noiseCount = 0; // Count of ticks while receiver is disabled
 
-#ifdef DEAF_WORKAROUND
-unsigned long _deafWorkaround = millis();
+// Carrier sense
+
+int rtl_433_ESP::carrierSenseThreshold = 0;
+int rtl_433_ESP::carrierSenseRejects = 0;
+
+#ifdef CARRIER_SENSE_GPIO
+#  define CARRIER_SENSE_AGCCTRL1 0x40 // AGC_LNA_PRIORITY, relative threshold disabled
+#  define CARRIER_SENSE_MIN      -7
+#  define CARRIER_SENSE_MAX      7
+
+static volatile bool _carrierStart = false; // Signal started by the interrupt, not yet seen by the task
+static unsigned long _carrierSenseAdjusted = 0; // millis() of the last carrier sense threshold change
+#endif
+
+// Receiver watchdog
+
+int rtl_433_ESP::deafDetections[DEAF_CAUSES] = {0};
+int rtl_433_ESP::receiverResets[DEAF_RESET_LEVELS] = {0};
+unsigned long rtl_433_ESP::lastRecoveryTime = 0;
+
+#ifdef DEAF_WATCHDOG
+#  define DEAF_MARCSTATE_MASK 0x1f
+#  define DEAF_MARCSTATE_RX   0x0d
+
+static const char* const _deafCauses[DEAF_CAUSES] = {"state", "rssi", "silence"};
+
+static volatile bool _silenceReported = false; // Set by the application, cleared by the receiver task
+static unsigned long _watchdogCheck = 0; // millis() of the last health check
+static int _failedChecks = 0; // Failed health checks in a row
+static int _resetLevel = -1; // Level of the last reset while not recovered, -1 once recovered
+static int _resetCause = 0;
+static int _resetDecoded = 0; // Decoded signals at the last reset
+static unsigned long _deafSince = 0; // millis() of the first detection of a deaf period
+
+// RSSI results of the current window
+static int _rssiSamples = 0;
+static int32_t _rssiSum = 0;
+static int64_t _rssiSquares = 0;
+static unsigned long _rssiWindowStart = 0; // millis()
+static int _rssiWindowDecoded = 0; // Decoded signals at the start of the window
+static bool _rssiMoved = false; // A window passed since the last reset
 #endif
 
 int16_t rtl_433_ESP::_interrupt = NOT_AN_INTERRUPT;
 static byte receiverGpio = -1;
+static float receiverFrequency = 0;
 
 static TaskHandle_t rtl_433_ReceiverHandle;
+// Held by the receiver task for a pass over the radio and by disableReceiver(),
+// so the radio is the caller's alone once disableReceiver() returns
+static SemaphoreHandle_t _radioMutex = NULL;
 
 /*----------------------------- End of variable initialization -----------------------------*/
 
@@ -144,6 +194,15 @@ void rtl_433_ESP::setRXSettings() {
 
   state = radio.SPIsetRegValue(RADIOLIB_CC1101_REG_MDMCFG4, 0x07); // Bandwidth
   RADIOLIB_STATE(state, "set MDMCFG4");
+
+#ifdef CARRIER_SENSE_GPIO
+  state = radio.SPIsetRegValue(RADIOLIB_CC1101_REG_IOCFG2, RADIOLIB_CC1101_GDOX_CARRIER_SENSE);
+  RADIOLIB_STATE(state, "set IOCFG2");
+
+  state = radio.SPIsetRegValue(RADIOLIB_CC1101_REG_AGCCTRL1,
+                               CARRIER_SENSE_AGCCTRL1 | (carrierSenseThreshold & 0x0f));
+  RADIOLIB_STATE(state, "set AGCCTRL1");
+#endif
 }
 
 /**
@@ -182,6 +241,45 @@ void rtl_433_ESP::initReceiver(byte inputPin, float receiveFrequency) {
 
   /*----------------------------- Initialize Transceiver -----------------------------*/
 
+  if (!_radioMutex) {
+    _radioMutex = xSemaphoreCreateMutex();
+  }
+
+  receiverFrequency = receiveFrequency;
+  resetReceiver();
+#ifdef ONBOARD_LED
+  pinMode(ONBOARD_LED, OUTPUT);
+  digitalWrite(ONBOARD_LED, LOW);
+#endif
+
+  _configureTransceiver();
+
+#ifdef RESOURCE_DEBUG
+  logprintfLn(LOG_INFO, "rtl_433_ReceiverTask_Stack %d", rtl_433_ReceiverTask_Stack);
+#endif
+
+#ifdef RF_MODULE_INIT_STATUS
+  getModuleStatus();
+#endif
+
+  if (!rtl_433_ReceiverHandle) {
+    xTaskCreatePinnedToCore(
+        rtl_433_ESP::rtl_433_ReceiverTask, /* Function to implement the task */
+        "rtl_433_ReceiverTask", /* Name of the task */
+        rtl_433_ReceiverTask_Stack, /* Stack size in bytes */
+        NULL, /* Task input parameter */
+        rtl_433_ReceiverTask_Priority, /* Priority of the task (set lower than core task) */
+        &rtl_433_ReceiverHandle, /* Task handle. */
+        rtl_433_ReceiverTask_Core); /* Core where the task should run */
+  }
+}
+
+/**
+ * @brief Configure the transceiver for the receiver and start reception, also
+ * used by the receiver watchdog to recover a deaf transceiver
+ *
+ */
+void rtl_433_ESP::_configureTransceiver() {
 #ifdef RF_CC1101
   int state = radio.begin();
 #else
@@ -189,12 +287,7 @@ void rtl_433_ESP::initReceiver(byte inputPin, float receiveFrequency) {
 #endif
   RADIOLIB_STATE(state, "radio.begin()");
 
-  radio.setFrequency(receiveFrequency);
-  resetReceiver();
-#ifdef ONBOARD_LED
-  pinMode(ONBOARD_LED, OUTPUT);
-  digitalWrite(ONBOARD_LED, LOW);
-#endif
+  radio.setFrequency(receiverFrequency);
 
   if (ookModulation) {
     state = radio.setOOK(true);
@@ -314,25 +407,6 @@ void rtl_433_ESP::initReceiver(byte inputPin, float receiveFrequency) {
   state = radio.receiveDirectAsync();
 #endif
   RADIOLIB_STATE(state, "receiveDirect");
-
-#ifdef RESOURCE_DEBUG
-  logprintfLn(LOG_INFO, "rtl_433_ReceiverTask_Stack %d", rtl_433_ReceiverTask_Stack);
-#endif
-
-#ifdef RF_MODULE_INIT_STATUS
-  getModuleStatus();
-#endif
-
-  if (!rtl_433_ReceiverHandle) {
-    xTaskCreatePinnedToCore(
-        rtl_433_ESP::rtl_433_ReceiverTask, /* Function to implement the task */
-        "rtl_433_ReceiverTask", /* Name of the task */
-        rtl_433_ReceiverTask_Stack, /* Stack size in bytes */
-        NULL, /* Task input parameter */
-        rtl_433_ReceiverTask_Priority, /* Priority of the task (set lower than core task) */
-        &rtl_433_ReceiverHandle, /* Task handle. */
-        rtl_433_ReceiverTask_Core); /* Core where the task should run */
-  }
 }
 
 /**
@@ -370,8 +444,10 @@ void ICACHE_RAM_ATTR rtl_433_ESP::interruptHandler() {
 
   /* We first do some filtering (same as pilight BPF) */
 
-#ifdef RF_CC1101
+#if defined(RF_CC1101) && !defined(CARRIER_SENSE_GPIO)
   if (duration > MINIMUM_PULSE_LENGTH && currentRssi > rssiThreshold)
+#elif defined(RF_CC1101)
+  if (duration > MINIMUM_PULSE_LENGTH) // receiveMode follows the carrier sense output
 #else
   if (duration > MINIMUM_PULSE_LENGTH) // SX127X RSSI Value drops for a 0 value,
   // and the OOK floor compensates for this
@@ -429,18 +505,45 @@ void rtl_433_ESP::enableReceiver() {
     pinMode(receiverGpio, INPUT);
     flushQueue();
     attachInterrupt((uint8_t)receiverGpio, interruptHandler, CHANGE);    
+#ifdef CARRIER_SENSE_GPIO
+    pinMode(CARRIER_SENSE_GPIO, INPUT);
+    attachInterrupt(digitalPinToInterrupt(CARRIER_SENSE_GPIO), carrierSenseHandler, CHANGE);
+#endif
     _enabledReceiver = true;
   }
 }
 
 /**
- * @brief Disable receiver logic, and pulse receiver
+ * @brief Disable receiver logic, and pulse receiver.  Waits for the receiver
+ * task to finish its pass over the radio, a receiver reset included
  * 
  */
 void rtl_433_ESP::disableReceiver() {
+  if (_radioMutex) {
+    xSemaphoreTake(_radioMutex, portMAX_DELAY);
+  }
   _enabledReceiver = false;
   detachInterrupt((uint8_t)receiverGpio);
+#ifdef CARRIER_SENSE_GPIO
+  detachInterrupt(digitalPinToInterrupt(CARRIER_SENSE_GPIO));
+  _carrierStart = false;
+#endif
+  if (receiveMode) { // signal in progress is lost
+    abortedSignals++;
+    receiveMode = false;
+    _nrpulses = 0;
+  }
   flushQueue();
+  if (_radioMutex) {
+    xSemaphoreGive(_radioMutex);
+  }
+}
+
+unsigned long rtl_433_ESP::channelQuietTime() {
+  if (receiveMode || currentRssi > rssiThreshold) {
+    return 0;
+  }
+  return (micros() - signalEnd) / 1000;
 }
 
 /**
@@ -449,18 +552,6 @@ void rtl_433_ESP::disableReceiver() {
  */
 void rtl_433_ESP::loop() {
   if (_enabledReceiver) {
-#if defined(RF_CC1101) && defined(DEAF_WORKAROUND)
-    // workaround for a deaf CC1101, see issue #16
-    if (millis() - _deafWorkaround > 3600000) // restart receiver every hour
-    {
-      _deafWorkaround = millis();
-      // radio.SetRx(); // set Receive on
-      radio.SPIsendCommand(RADIOLIB_CC1101_CMD_IDLE); // set Receive on
-      radio.SPIsendCommand(RADIOLIB_CC1101_CMD_RX); // set Receive on
-
-    } // workaround for a deaf CC1101
-#endif
-
     int _receiveTrain = receivePulseTrain();
     if (_receiveTrain != -1) // Is there anything to receive ?
     {
@@ -538,34 +629,26 @@ void rtl_433_ESP::loop() {
  * @param pvParameters 
  */
 void rtl_433_ESP::rtl_433_ReceiverTask(void* pvParameters) {
+#ifdef CARRIER_SENSE_GPIO
   for (;;) {
+    TickType_t wait = pdMS_TO_TICKS(CARRIER_SENSE_SAMPLE_INTERVAL);
+    xSemaphoreTake(_radioMutex, portMAX_DELAY);
     if (_enabledReceiver) {
-      // Calculate average RSSI signal level in environment
-
-      currentRssi = _getRSSI();
-      _rssiCount++;
-      _totalRssi += currentRssi;
-
-      if (_rssiCount > RSSI_SAMPLES) // Adjust RSSI Signal Threshold
-      {
-        averageRssi = _totalRssi / _rssiCount;
-
-#ifdef AUTORSSITHRESHOLD
-        rssiThreshold = averageRssi + rssiThresholdDelta;
-
-        if (rssiThreshold < MINRSSI) {
-          rssiThreshold = MINRSSI;
-        }
-        
-        logprintfLn(LOG_DEBUG,
-                    "Average RSSI Signal %d dbm, adjusted RSSI Threshold %d, "
-                    "samples %d",
-                    averageRssi, rssiThreshold, RSSI_SAMPLES);
-#endif
+      wait = _carrierSenseStep();
+#  ifdef DEAF_WATCHDOG
+      _watchdogStep();
+#  endif
+    }
+    xSemaphoreGive(_radioMutex);
+    ulTaskNotifyTake(pdTRUE, wait);
+  }
+#else
+  for (;;) {
+    xSemaphoreTake(_radioMutex, portMAX_DELAY);
+    if (_enabledReceiver) {
+      // Track the RSSI noise floor in environment
 
-        _totalRssi = 0;
-        _rssiCount = 0;
-      }
+      _sampleNoiseFloor(!receiveMode);
 
       if (currentRssi > rssiThreshold) // A signal is present
       {
@@ -614,62 +697,232 @@ void rtl_433_ESP::rtl_433_ReceiverTask(void* pvParameters) {
       {
         if (receiveMode) // Complete reception of a signal
         {
+          _endSignal();
+        }
+      }
+#  ifdef DEAF_WATCHDOG
+      _watchdogStep();
+#  endif
+    }
+    xSemaphoreGive(_radioMutex);
+    vTaskDelay(1);
+  }
+#endif
+}
+
+/**
+ * @brief Complete reception of a signal, pass it to the decoder if it is long
+ * enough and has enough pulses
+ *
+ */
+void rtl_433_ESP::_endSignal() {
 #ifdef ONBOARD_LED
-          digitalWrite(ONBOARD_LED, LOW);
-#endif
-          receiveMode = false;
-          totalSignals++;
-          if ((_nrpulses > PD_MIN_PULSES) &&
-              ((signalEnd - signalStart) >
-               MINIMUM_SIGNAL_LENGTH)) // Minimum signal length of MINIMUM_SIGNAL_LENGTH MS
-          {
-            _pulseTrains[_actualPulseTrain].num_pulses = _nrpulses + 1;
-            _pulseTrains[_actualPulseTrain].signalDuration =
-                signalEnd - signalStart;
-            _pulseTrains[_actualPulseTrain].signalRssi = signalRssi;
+  digitalWrite(ONBOARD_LED, LOW);
+#endif
+  receiveMode = false;
+  totalSignals++;
+  if ((_nrpulses > PD_MIN_PULSES) &&
+      ((signalEnd - signalStart) >
+       MINIMUM_SIGNAL_LENGTH)) // Minimum signal length of MINIMUM_SIGNAL_LENGTH MS
+  {
+    _pulseTrains[_actualPulseTrain].num_pulses = _nrpulses + 1;
+    _pulseTrains[_actualPulseTrain].signalDuration =
+        signalEnd - signalStart;
+    _pulseTrains[_actualPulseTrain].signalRssi = signalRssi;
 #ifdef DEMOD_DEBUG
-            logprintf(LOG_INFO, "Signal length: %lu",
-                      _pulseTrains[_actualPulseTrain].signalDuration);
-            alogprintf(LOG_INFO, ", Gap length: %lu", signalStart - gapStart);
-            alogprintf(LOG_INFO, ", Signal RSSI: %d",
-                       _pulseTrains[_actualPulseTrain].signalRssi);
-            alogprintf(LOG_INFO, ", train: %d", _actualPulseTrain);
-            alogprintf(LOG_INFO, ", messageCount: %d", messageCount);
-            alogprintfLn(LOG_INFO, ", pulses: %d", _nrpulses);
-#endif
-            messageCount++;
-            gapStart = micros();
-            _actualPulseTrain = (_actualPulseTrain + 1) % RECEIVER_BUFFER_SIZE;
-            _nrpulses = 0;
-          } else {
-            ignoredSignals++;
+    logprintf(LOG_INFO, "Signal length: %lu",
+              _pulseTrains[_actualPulseTrain].signalDuration);
+    alogprintf(LOG_INFO, ", Gap length: %lu", signalStart - gapStart);
+    alogprintf(LOG_INFO, ", Signal RSSI: %d",
+               _pulseTrains[_actualPulseTrain].signalRssi);
+    alogprintf(LOG_INFO, ", train: %d", _actualPulseTrain);
+    alogprintf(LOG_INFO, ", messageCount: %d", messageCount);
+    alogprintfLn(LOG_INFO, ", pulses: %d", _nrpulses);
+#endif
+    messageCount++;
+    gapStart = micros();
+    _actualPulseTrain = (_actualPulseTrain + 1) % RECEIVER_BUFFER_SIZE;
+    _nrpulses = 0;
+  } else {
+    ignoredSignals++;
 #ifdef DEMOD_DEBUG
-            if (micros() - signalStart > 1000) {
-              logprintf(LOG_INFO, "Ignored Signal length: %lu",
-                        signalEnd - signalStart);
-
-              alogprintf(LOG_INFO, ", Time since last bit length: %lu",
-                         micros() - signalEnd);
-              alogprintf(LOG_INFO, ", Gap length: %lu", signalStart - gapStart);
-              alogprintf(LOG_INFO, ", Signal RSSI: %d", signalRssi);
-              alogprintf(LOG_INFO, ", Current RSSI: %d", currentRssi);
-              alogprintf(LOG_INFO, ", pulses: %d", _nrpulses);
-              alogprintfLn(LOG_INFO, ", noise count: %d", _noiseCount);
-              gapStart = micros();
-            }
-#endif
-            _nrpulses = 0;
-          }
+    if (micros() - signalStart > 1000) {
+      logprintf(LOG_INFO, "Ignored Signal length: %lu",
+                signalEnd - signalStart);
+
+      alogprintf(LOG_INFO, ", Time since last bit length: %lu",
+                 micros() - signalEnd);
+      alogprintf(LOG_INFO, ", Gap length: %lu", signalStart - gapStart);
+      alogprintf(LOG_INFO, ", Signal RSSI: %d", signalRssi);
+      alogprintf(LOG_INFO, ", Current RSSI: %d", currentRssi);
+      alogprintf(LOG_INFO, ", pulses: %d", _nrpulses);
+      alogprintfLn(LOG_INFO, ", noise count: %d", _noiseCount);
+      gapStart = micros();
+    }
+#endif
+    _nrpulses = 0;
+  }
 #ifdef MEMORY_DEBUG
-          logprintfLn(LOG_INFO,
-                      "rtl_433_ReceiverTask uxTaskGetStackHighWaterMark: %d", uxTaskGetStackHighWaterMark(NULL));
+  logprintfLn(LOG_INFO,
+              "rtl_433_ReceiverTask uxTaskGetStackHighWaterMark: %d", uxTaskGetStackHighWaterMark(NULL));
 #endif
-        }
+}
+
+/**
+ * @brief Read the RSSI and feed it to the noise floor estimate
+ *
+ * @param signalFree - no signal is present
+ */
+void rtl_433_ESP::_sampleNoiseFloor(bool signalFree) {
+  currentRssi = _getRSSI();
+
+#ifdef DEAF_WATCHDOG
+  _rssiSamples++;
+  _rssiSum += currentRssi;
+  _rssiSquares += (int64_t)currentRssi * currentRssi;
+#endif
+
+  // Samples taken while receiving are signal, unless the "signal" lasts
+  // long enough to be a raised floor the estimate has to follow
+  if (signalFree || micros() - signalStart > NOISE_FLOOR_MAX_SIGNAL) {
+    _updateNoiseFloor(currentRssi);
+  }
+
+  if (++_rssiCount > RSSI_SAMPLES) {
+#ifdef AUTORSSITHRESHOLD
+    logprintfLn(LOG_DEBUG,
+                "Noise floor %d dbm, adjusted RSSI Threshold %d, "
+                "samples %d",
+                averageRssi, rssiThreshold, RSSI_SAMPLES);
+#endif
+    _rssiCount = 0;
+  }
+}
+
+#ifdef CARRIER_SENSE_GPIO
+/**
+ * @brief Start a signal when the carrier sense output rises, the end of the
+ * carrier is recorded as end of signal.  The receiver task is woken to read
+ * the signal RSSI.
+ *
+ */
+void ICACHE_RAM_ATTR rtl_433_ESP::carrierSenseHandler() {
+  const unsigned long now = micros();
+
+  if (!digitalRead(CARRIER_SENSE_GPIO)) {
+    signalEnd = now;
+  } else if (_enabledReceiver && !receiveMode) {
+    receiveMode = true;
+    signalStart = now;
+    signalEnd = now;
+    _lastChange = now;
+    _carrierStart = true;
+
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(rtl_433_ReceiverHandle, &woken);
+    if (woken) {
+      portYIELD_FROM_ISR();
+    }
+  }
+}
+
+/**
+ * @brief One pass of the receiver task in carrier sense mode
+ *
+ * Signal start and end are timestamped by carrierSenseHandler(), the task
+ * only reads the RSSI at the start of a signal and every
+ * CARRIER_SENSE_SAMPLE_INTERVAL for the noise floor.  A start at or below
+ * rssiThreshold is dropped, as a polling receiver would not have started it,
+ * and raises the carrier sense threshold, as does a carrier held longer than
+ * NOISE_FLOOR_MAX_SIGNAL by an RSSI at or below rssiThreshold.  The threshold is lowered when the
+ * RSSI is above rssiThreshold without a carrier, or after
+ * CARRIER_SENSE_PROBE_INTERVAL without a change, so it settles just above
+ * the noise.
+ *
+ * @return TickType_t ticks until the next pass unless woken by a signal
+ */
+TickType_t rtl_433_ESP::_carrierSenseStep() {
+  if (!receiveMode) {
+    _sampleNoiseFloor(true);
+
+    if (digitalRead(CARRIER_SENSE_GPIO)) { // Carrier present before the interrupt was attached
+      signalStart = micros();
+      signalEnd = signalStart;
+      _lastChange = signalStart;
+      _carrierStart = true;
+      receiveMode = true;
+    } else if (currentRssi > rssiThreshold + 1 ||
+               millis() - _carrierSenseAdjusted > CARRIER_SENSE_PROBE_INTERVAL) {
+      _setCarrierSenseThreshold(carrierSenseThreshold - 1);
+    }
+  }
+
+  if (!receiveMode) {
+    return pdMS_TO_TICKS(CARRIER_SENSE_SAMPLE_INTERVAL);
+  }
+
+  if (_carrierStart) {
+    _carrierStart = false;
+    currentRssi = _getRSSI();
+
+    if (currentRssi <= rssiThreshold) { // Noise, a polling receiver would not have started
+      receiveMode = false;
+      _nrpulses = 0;
+      carrierSenseRejects++;
+      _setCarrierSenseThreshold(carrierSenseThreshold + 1);
+      return pdMS_TO_TICKS(CARRIER_SENSE_SAMPLE_INTERVAL);
+    }
+
+    signalRssi = currentRssi;
+#  ifdef ONBOARD_LED
+    digitalWrite(ONBOARD_LED, HIGH);
+#  endif
+  }
+
+  if (digitalRead(CARRIER_SENSE_GPIO)) {
+    if (micros() - signalStart > NOISE_FLOOR_MAX_SIGNAL) {
+      _sampleNoiseFloor(false);
+      if (currentRssi <= rssiThreshold) { // Carrier held by noise
+        _setCarrierSenseThreshold(carrierSenseThreshold + 1);
       }
     }
-    vTaskDelay(1);
+    return pdMS_TO_TICKS(CARRIER_SENSE_SAMPLE_INTERVAL);
+  }
+
+  // If we received a signal but had a minor drop in strength keep the
+  // receiver running for an additional 40,000, the RSSI is below the carrier
+  // sense threshold meanwhile
+  unsigned long quiet = micros() - signalEnd;
+  if (quiet < MINIMUM_SIGNAL_LENGTH && micros() - signalStart > 30000) {
+    _sampleNoiseFloor(true);
+    TickType_t wait = pdMS_TO_TICKS((MINIMUM_SIGNAL_LENGTH - quiet) / 1000) + 1;
+    return wait < pdMS_TO_TICKS(CARRIER_SENSE_SAMPLE_INTERVAL) ? wait : pdMS_TO_TICKS(CARRIER_SENSE_SAMPLE_INTERVAL);
+  }
+
+  _endSignal();
+  return pdMS_TO_TICKS(CARRIER_SENSE_SAMPLE_INTERVAL);
+}
+
+/**
+ * @brief Set the CC1101 absolute carrier sense threshold, in dB relative to
+ * MAGN_TARGET
+ *
+ * @param threshold
+ */
+void rtl_433_ESP::_setCarrierSenseThreshold(int threshold) {
+  if (threshold < CARRIER_SENSE_MIN) {
+    threshold = CARRIER_SENSE_MIN;
+  } else if (threshold > CARRIER_SENSE_MAX) {
+    threshold = CARRIER_SENSE_MAX;
+  }
+  _carrierSenseAdjusted = millis();
+  if (threshold != carrierSenseThreshold) {
+    carrierSenseThreshold = threshold;
+    radio.SPIwriteRegister(RADIOLIB_CC1101_REG_AGCCTRL1,
+                           CARRIER_SENSE_AGCCTRL1 | (threshold & 0x0f));
   }
 }
+#endif
 
 /**
  * @brief Client callback to receive decoded signals
@@ -691,6 +944,18 @@ void rtl_433_ESP::setCallback(rtl_433_ESPCallBack callback, char* messageBuffer,
   _setCallback(callback, messageBuffer, bufferSize, dataBuffer, dataBufferSize);
 }
 
+/**
+ * @brief Client callback to receive decoded signals in binary form
+ * 
+ * @param callback 
+ * @param eventBuffer 
+ * @param bufferSize 
+ */
+void rtl_433_ESP::setEventCallback(rtl_433_ESPEventCallBack callback,
+                                   uint8_t* eventBuffer, int bufferSize) {
+  _setEventCallback(callback, eventBuffer, bufferSize);
+}
+
 /**
  * @brief Set delta applied to average RSSI level for determining start and end of signal
  * 
@@ -750,6 +1015,8 @@ void rtl_433_ESP::getStatus() {
   alogprintf(LOG_INFO, ", signalRatio: %d", signalRatio);
   alogprintf(LOG_INFO, ", ignoredSignals: %d", ignoredSignals);
   alogprintf(LOG_INFO, ", unparsedSignals: %d", unparsedSignals);
+  alogprintf(LOG_INFO, ", suppressedRepeats: %u", g_cfg.suppressedRepeats);
+  alogprintf(LOG_INFO, ", abortedSignals: %d", abortedSignals);
   alogprintf(LOG_INFO, ", _enabledReceiver: %d", _enabledReceiver);
   alogprintf(LOG_INFO, ", receiveMode: %d", receiveMode);
   alogprintf(LOG_INFO, ", currentRssi: %d", currentRssi);
@@ -775,12 +1042,28 @@ void rtl_433_ESP::getStatus() {
                "RTLOOKThresh",    "", DATA_INT,     OokFixedThreshold,
 #endif
 
+#ifdef CARRIER_SENSE_GPIO
+                "RTLCSThresh",    "", DATA_INT,     carrierSenseThreshold,
+                "RTLCSRejects",   "", DATA_INT,     carrierSenseRejects,
+#endif
+
+#ifdef DEAF_WATCHDOG
+                "deafState",      "", DATA_INT,     deafDetections[DEAF_STATE],
+                "deafRssi",       "", DATA_INT,     deafDetections[DEAF_RSSI],
+                "deafSilence",    "", DATA_INT,     deafDetections[DEAF_SILENCE],
+                "resetRestart",   "", DATA_INT,     receiverResets[DEAF_RESET_RESTART],
+                "resetReconfigure", "", DATA_INT,   receiverResets[DEAF_RESET_RECONFIGURE],
+                "recoveryTime",   "", DATA_INT,     (int)lastRecoveryTime,
+#endif
+
                 "train",          "", DATA_INT, _actualPulseTrain,
                 "RTLCnt",         "", DATA_INT, messageCount,
                 "totalSignals",   "", DATA_INT, totalSignals,
                 "signalRatio",    "", DATA_INT, signalRatio,
                 "ignoredSignals", "", DATA_INT, ignoredSignals,
                 "unparsedSignals", "", DATA_INT, unparsedSignals,
+                "suppressedRepeats", "", DATA_INT, g_cfg.suppressedRepeats,
+                "abortedSignals", "", DATA_INT, abortedSignals,
                 "StackHWM",       "", DATA_INT, uxTaskGetStackHighWaterMark(NULL),
                 "RTL_HWM",        "", DATA_INT, uxTaskGetStackHighWaterMark(rtl_433_ReceiverHandle),
                 "DCD_HWM",        "", DATA_INT, uxTaskGetStackHighWaterMark(rtl_433_DecoderHandle),
@@ -814,6 +1097,154 @@ int rtl_433_ESP::_getRSSI(void) {
   return rssi;
 }
 
+/**
+ * @brief Update the noise floor with a signal free rssi result
+ *
+ * Streaming percentile estimate: a result below the estimate lowers it by
+ * NOISE_FLOOR_STEP * ( 100 - NOISE_FLOOR_PERCENTILE ) / 100, one above raises
+ * it by NOISE_FLOOR_STEP * NOISE_FLOOR_PERCENTILE / 100, which balances where
+ * NOISE_FLOOR_PERCENTILE percent of the results are below.  The fractions of
+ * 1/256 dB are carried over in _noiseFloorRemainder, so a small step in one
+ * direction is not rounded away.  Unlike an average it is not pulled up by
+ * strong signals, and with the defaults it follows a change of the
+ * environment within a second instead of after RSSI_SAMPLES results.
+ *
+ * @param rssi
+ */
+void rtl_433_ESP::_updateNoiseFloor(int rssi) {
+  int32_t sample = (int32_t)rssi * 256;
+
+  if (!_noiseFloorValid) {
+    _noiseFloor = sample;
+    _noiseFloorValid = true;
+  } else if (sample < _noiseFloor) {
+    _noiseFloorRemainder -= NOISE_FLOOR_STEP * (100 - NOISE_FLOOR_PERCENTILE);
+  } else if (sample > _noiseFloor) {
+    _noiseFloorRemainder += NOISE_FLOOR_STEP * NOISE_FLOOR_PERCENTILE;
+  }
+  _noiseFloor += _noiseFloorRemainder / 100;
+  _noiseFloorRemainder %= 100;
+  averageRssi = (_noiseFloor + 128) >> 8;
+
+#ifdef AUTORSSITHRESHOLD
+  int threshold = averageRssi + rssiThresholdDelta;
+  rssiThreshold = threshold < MINRSSI ? MINRSSI : threshold;
+#endif
+}
+
+/**
+ * @brief Report that the application did not hear expected signals, handled
+ * by the receiver task on its next pass
+ *
+ */
+void rtl_433_ESP::reportSilence() {
+#ifdef DEAF_WATCHDOG
+  _silenceReported = true;
+#endif
+}
+
+#ifdef DEAF_WATCHDOG
+/**
+ * @brief Receiver health check, run by the receiver task every
+ * DEAF_CHECK_INTERVAL.  A transceiver that left RX fails the check,
+ * DEAF_CONFIRM failed checks in a row reset the receiver.  An RSSI that did
+ * not move at all over DEAF_RSSI_WINDOW while nothing was decoded, or a
+ * silence reported by the application, resets it as well.  This replaces
+ * the unconditional restart every hour, a transceiver out of RX is found
+ * within seconds and a healthy one is left alone.
+ *
+ */
+void rtl_433_ESP::_watchdogStep() {
+  if (millis() - _watchdogCheck < DEAF_CHECK_INTERVAL && !_silenceReported) {
+    return;
+  }
+  _watchdogCheck = millis();
+
+  bool stateFailed = (radio.SPIreadRegister(RADIOLIB_CC1101_REG_MARCSTATE) &
+                      DEAF_MARCSTATE_MASK) != DEAF_MARCSTATE_RX;
+  _failedChecks = stateFailed ? _failedChecks + 1 : 0;
+
+  int decoded = messageCount - unparsedSignals;
+  bool rssiFailed = false;
+  if (millis() - _rssiWindowStart >= DEAF_RSSI_WINDOW) {
+    // A decoded signal proves the receiver hears, however flat the RSSI
+    if (_rssiSamples >= DEAF_RSSI_MIN_SAMPLES && decoded == _rssiWindowDecoded) {
+      // n^2 * variance, compared without a division
+      int64_t spread = (int64_t)_rssiSamples * _rssiSquares - (int64_t)_rssiSum * _rssiSum;
+      rssiFailed = spread * 100 < (int64_t)DEAF_RSSI_VARIANCE * _rssiSamples * _rssiSamples;
+    }
+    _rssiMoved = !rssiFailed;
+    _rssiSamples = 0;
+    _rssiSum = 0;
+    _rssiSquares = 0;
+    _rssiWindowStart = millis();
+    _rssiWindowDecoded = decoded;
+  }
+
+  if (_failedChecks >= DEAF_CONFIRM || rssiFailed) {
+    _recoverReceiver(stateFailed ? DEAF_STATE : DEAF_RSSI);
+  } else if (_silenceReported) {
+    _silenceReported = false;
+    _recoverReceiver(DEAF_SILENCE);
+  } else if (_resetLevel >= 0 && _failedChecks == 0 &&
+             (_resetCause == DEAF_STATE || decoded != _resetDecoded ||
+              (_resetCause == DEAF_RSSI && _rssiMoved))) {
+    lastRecoveryTime = millis() - _deafSince;
+    logprintfLn(LOG_INFO, "Receiver recovered by reset level %d after %lu ms",
+                _resetLevel, lastRecoveryTime);
+    _resetLevel = -1;
+  }
+}
+
+/**
+ * @brief Reset a deaf receiver with the least intrusive level that was not
+ * tried yet since the receiver was last seen working: first back to RX, then
+ * a chip reset with the full receiver configuration.
+ *
+ * @param cause - DEAF_STATE, DEAF_RSSI or DEAF_SILENCE
+ */
+void rtl_433_ESP::_recoverReceiver(int cause) {
+  if (_resetLevel < 0) {
+    _deafSince = millis();
+  }
+  int level = _resetLevel + 1 < DEAF_RESET_LEVELS ? _resetLevel + 1 : DEAF_RESET_LEVELS - 1;
+
+  if (receiveMode) { // signal in progress is lost
+    abortedSignals++;
+    receiveMode = false;
+    _nrpulses = 0;
+  }
+
+  if (level == DEAF_RESET_RESTART) {
+    radio.SPIsendCommand(RADIOLIB_CC1101_CMD_IDLE);
+    radio.SPIsendCommand(RADIOLIB_CC1101_CMD_RX);
+  } else {
+    _configureTransceiver();
+  }
+
+  deafDetections[cause]++;
+  receiverResets[level]++;
+  _resetLevel = level;
+  _resetCause = cause;
+  _resetDecoded = messageCount - unparsedSignals;
+  _failedChecks = 0;
+  _rssiSamples = 0;
+  _rssiSum = 0;
+  _rssiSquares = 0;
+  _rssiWindowStart = millis();
+  _rssiWindowDecoded = _resetDecoded;
+  _rssiMoved = false;
+
+  logprintfLn(LOG_INFO,
+              "Receiver deaf ( %s ), reset level %d, detections state %d rssi %d "
+              "silence %d, resets restart %d reconfigure %d",
+              _deafCauses[cause], level, deafDetections[DEAF_STATE],
+              deafDetections[DEAF_RSSI], deafDetections[DEAF_SILENCE],
+              receiverResets[DEAF_RESET_RESTART],
+              receiverResets[DEAF_RESET_RECONFIGURE]);
+}
+#endif
+
 /**
  * Send to serial output current transceiver status
  *
@@ -1004,6 +1435,6 @@ int16_t rtl_433_ESP::setRxBandwidth(float value) {
 }
 #endif
 
-CC1101 rtl_433_ESP:: getRadio() {
+CC1101& rtl_433_ESP::getRadio() {
   return radio;
 }
\ No newline at end of file
@@ -59,11 +59,68 @@
 #  define DEAF_WORKAROUND
 #endif
 
-// Number of rssi results to collect for average calculation
+// Watch the CC1101 for going deaf, and reset the receiver when it does
+#if defined(DEAF_WORKAROUND) && defined(RF_CC1101)
+#  define DEAF_WATCHDOG
+#endif
+
+// mS between receiver health checks
+#ifndef DEAF_CHECK_INTERVAL
+#  define DEAF_CHECK_INTERVAL 1000
+#endif
+
+// Failed health checks in a row before the receiver is reset
+#ifndef DEAF_CONFIRM
+#  define DEAF_CONFIRM 2
+#endif
+
+// RSSI variance over a window, in 1/100 dB^2, below which the RSSI is taken
+// as stuck
+#ifndef DEAF_RSSI_VARIANCE
+#  define DEAF_RSSI_VARIANCE 1
+#endif
+
+// mS the RSSI has to stay flat with nothing decoded before it is taken as
+// stuck, a quiet band can round every result to the same dBm for a while
+#ifndef DEAF_RSSI_WINDOW
+#  define DEAF_RSSI_WINDOW 60000
+#endif
+
+// RSSI results needed in a window for the variance to count
+#define DEAF_RSSI_MIN_SAMPLES 20
+
+// Causes of a receiver reset
+#define DEAF_STATE   0 // Transceiver not in RX
+#define DEAF_RSSI    1 // RSSI stuck
+#define DEAF_SILENCE 2 // Reported by the application, expected signals not heard
+#define DEAF_CAUSES  3
+
+// Receiver reset levels, each tried when the one before did not help
+#define DEAF_RESET_RESTART     0 // Idle and back to RX
+#define DEAF_RESET_RECONFIGURE 1 // Chip reset and full receiver configuration
+#define DEAF_RESET_LEVELS      2
+
+// Number of rssi results between noise floor reports
 #ifndef RSSI_SAMPLES
 #  define RSSI_SAMPLES 50000
 #endif
 
+// Percentile of the signal free rssi results tracked as noise floor
+#ifndef NOISE_FLOOR_PERCENTILE
+#  define NOISE_FLOOR_PERCENTILE 50
+#endif
+
+// Noise floor adjustment per rssi result, in 1/256 dB, split between up and
+// down by NOISE_FLOOR_PERCENTILE
+#ifndef NOISE_FLOOR_STEP
+#  define NOISE_FLOOR_STEP 8
+#endif
+
+// Signals longer than this ( uS ) are taken as a raised noise floor
+#ifndef NOISE_FLOOR_MAX_SIGNAL
+#  define NOISE_FLOOR_MAX_SIGNAL 500000
+#endif
+
 //  Amount to add to average RSSI to determine if a signal is present
 #ifndef RSSI_THRESHOLD
 #  define RSSI_THRESHOLD 9
@@ -74,6 +131,29 @@
 #  define AUTORSSITHRESHOLD true
 #endif
 
+// Detect signal start and end by the carrier sense output of the CC1101 on
+// GDO2 rather than by polling RSSI, RSSI is then only read for the noise floor
+#if defined(CARRIER_SENSE) && defined(RF_CC1101) && defined(RF_MODULE_GDO2)
+#  define CARRIER_SENSE_GPIO RF_MODULE_GDO2
+#endif
+
+// Driving the LED would fight the carrier sense output
+#if defined(CARRIER_SENSE_GPIO) && defined(ONBOARD_LED)
+#  if ONBOARD_LED == CARRIER_SENSE_GPIO
+#    error "CARRIER_SENSE needs ONBOARD_LED on another pin than RF_MODULE_GDO2"
+#  endif
+#endif
+
+// mS between noise floor samples in carrier sense mode
+#ifndef CARRIER_SENSE_SAMPLE_INTERVAL
+#  define CARRIER_SENSE_SAMPLE_INTERVAL 10
+#endif
+
+// mS without a carrier sense threshold change before it is lowered by 1 dB
+#ifndef CARRIER_SENSE_PROBE_INTERVAL
+#  define CARRIER_SENSE_PROBE_INTERVAL 10000
+#endif
+
 // #define AUTOOOKFIX true      // Has shown to be problematic
 
 // Pulse train buffer count
@@ -227,6 +307,11 @@
  */
 typedef void (*rtl_433_ESPCallBack)(char* message, uint8_t* data, int dataSize);
 
+/**
+ * event - CBOR encoded message from device, see data_print_cbor()
+ */
+typedef void (*rtl_433_ESPEventCallBack)(uint8_t* event, int eventSize);
+
 typedef std::function<void(const uint16_t* pulses, size_t length)>
     PulseTrainCallBack;
 
@@ -257,6 +342,17 @@ public:
   void setCallback(rtl_433_ESPCallBack callback, char* messageBuffer,
                    int bufferSize, uint8_t* dataBuffer, int dataBufferSize);
 
+  /**
+   * Set binary event callback function, called after the message callback
+   * with a compact CBOR encoding of the same message
+   *
+   * callback    - binary event callback
+   * eventBuffer - binary event buffer
+   * bufferSize  - size of binary event buffer
+   */
+  void setEventCallback(rtl_433_ESPEventCallBack callback, uint8_t* eventBuffer,
+                        int bufferSize);
+
   /**
    * Set minimum RSSI value for receiver
    */
@@ -288,6 +384,8 @@ public:
 
   /**
    * Disable decoding. You can re-enable decoding by calling enableReceiver();
+   * Returns once the receiver task is done with the radio, which can then be
+   * used for transmitting
    */
   static void disableReceiver();
 
@@ -331,8 +429,22 @@ public:
 
   static int rssiThresholdDelta;
 
+  /**
+   * Estimated noise floor, percentile of the rssi while no signal is received
+   */
   static int averageRssi;
 
+  /**
+   * CC1101 absolute carrier sense threshold in dB relative to MAGN_TARGET,
+   * adjusted to follow rssiThreshold in carrier sense mode
+   */
+  static int carrierSenseThreshold;
+
+  /**
+   * Carrier sense starts dropped for an RSSI at or below rssiThreshold
+   */
+  static int carrierSenseRejects;
+
   /**
    * Functions used during testing
    */
@@ -359,6 +471,17 @@ public:
   static int ignoredSignals;
   static int unparsedSignals;
 
+  /**
+   * Signals cut short because the receiver was disabled during reception
+   */
+  static int abortedSignals;
+
+  /**
+   * @brief milliseconds since a signal was last present, 0 while a signal is
+   * being received.  Lets a transmitting application wait for a quiet channel.
+   */
+  static unsigned long channelQuietTime();
+
   static uint8_t OokFixedThreshold;
 
   /*----------------------------- Future features -----------------------------*/
@@ -383,7 +506,34 @@ public:
    */
   static bool setFSKModulation();
 
-  static CC1101 getRadio();
+  /**
+   * @brief the transceiver used by the receiver, for applications that also
+   * transmit with it
+   */
+  static CC1101& getRadio();
+
+  /**
+   * @brief Report that the receiver looks deaf to the application, e.g. no
+   * sensor was heard for much longer than expected.  The receiver task
+   * resets the receiver, one level further than last time if the previous
+   * reset was not followed by a message.
+   */
+  static void reportSilence();
+
+  /**
+   * Receiver deaf detections per cause, DEAF_STATE .. DEAF_SILENCE
+   */
+  static int deafDetections[DEAF_CAUSES];
+
+  /**
+   * Receiver resets per level, DEAF_RESET_RESTART .. DEAF_RESET_RECONFIGURE
+   */
+  static int receiverResets[DEAF_RESET_LEVELS];
+
+  /**
+   * mS from the first detection of the last deaf period to its recovery
+   */
+  static unsigned long lastRecoveryTime;
 
 private:
   int8_t _outputPin;
@@ -401,6 +551,12 @@ private:
    */
   static void calibrateOokFixedThresholdHandler();
 
+  /**
+   * carrierSenseHandler is called on every change of the carrier sense
+   * output, and starts a signal with a micros() timestamp
+   */
+  static void carrierSenseHandler();
+
   /**
    * Quasi-reset. Called when the current edge is too long or short.
    * reset "promotes" the current edge as being the first edge of a new
@@ -409,6 +565,18 @@ private:
   static void resetReceiver();
 
   static int _getRSSI();
+  static void _sampleNoiseFloor(bool);
+  static void _updateNoiseFloor(int);
+  static void _endSignal();
+  static void _configureTransceiver();
+#ifdef DEAF_WATCHDOG
+  static void _watchdogStep();
+  static void _recoverReceiver(int cause);
+#endif
+#ifdef CARRIER_SENSE_GPIO
+  static TickType_t _carrierSenseStep();
+  static void _setCarrierSenseThreshold(int);
+#endif
 
   /**
    * Get last received PulseTrain.
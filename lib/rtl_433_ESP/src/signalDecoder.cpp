@@ -443,6 +443,14 @@ void _setCallback(rtl_433_ESPCallBack callback, char* messageBuffer,
   cfg->dataBufferSize = dataBufferSize;
 }
 
+void _setEventCallback(rtl_433_ESPEventCallBack callback, uint8_t* eventBuffer,
+                       int bufferSize) {
+  r_cfg_t* cfg = &g_cfg;
+  cfg->eventCallback = callback;
+  cfg->eventBuffer = eventBuffer;
+  cfg->eventBufferSize = bufferSize;
+}
+
 void _setDebug(int debug) {
   rtlVerbose = debug;
   logprintfLn(LOG_INFO, "Setting rtl_433 debug to: %d", rtlVerbose);
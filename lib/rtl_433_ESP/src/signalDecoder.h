@@ -48,10 +48,13 @@ extern "C" {
 void rtlSetup();
 void _setCallback(rtl_433_ESPCallBack callback, char* messageBuffer,
                   int bufferSize, uint8_t* dataBuffer, int dataBufferSize);
+void _setEventCallback(rtl_433_ESPEventCallBack callback, uint8_t* eventBuffer,
+                       int bufferSize);
 void _setDebug(int debug);
 void processSignal(pulse_data_t* rtl_pulses);
 void rtl_433_DecoderTask(void* pvParameters);
 void flushQueue();
 extern TaskHandle_t rtl_433_DecoderHandle;
+extern r_cfg_t g_cfg;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+"""Decode the binary (CBOR) event stream written by data_print_cbor().
+
+Frames on the wire are
+
+    0xA5 | length | CBOR payload (length bytes) | sum of payload bytes & 0xff
+
+Integer map keys are interned keys and are expanded with KEYS below, which
+has to match data_cbor_keys[] in src/rtl_433/data.c.  Each decoded event is
+printed as one line of JSON, like the text output of the library.
+
+Usage:
+    event_decoder.py capture.bin
+    event_decoder.py --port /dev/ttyUSB0 --baud 9600   (requires pyserial)
+    event_decoder.py --raw payload.cbor                (unframed CBOR items)
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+KEYS = [
+    "model",
+    "type",
+    "id",
+    "flags",
+    "pressure_kPa",
+    "temperature_C",
+    "temperature_F",
+    "mic",
+    "protocol",
+    "rssi",
+    "duration",
+    "battery_ok",
+    "channel",
+    "humidity",
+    "subtype",
+    "status",
+    "state",
+    "code",
+    "button",
+    "pressure_PSI",
+    "moving",
+    "learn",
+    "alarm",
+]
+
+FRAME_SYNC = 0xA5
+
+
+class DecodeError(Exception):
+    pass
+
+
+def _read_uint(buf, pos, info):
+    if info < 24:
+        return info, pos
+    size = {24: 1, 25: 2, 26: 4, 27: 8}.get(info)
+    if size is None or pos + size > len(buf):
+        raise DecodeError("bad length encoding")
+    return int.from_bytes(buf[pos:pos + size], "big"), pos + size
+
+
+def decode_item(buf, pos=0, is_key=False):
+    """Decode one CBOR item, returns (value, next position)."""
+    if pos >= len(buf):
+        raise DecodeError("truncated item")
+    initial = buf[pos]
+    major, info = initial >> 5, initial & 0x1F
+    pos += 1
+
+    if major == 7:
+        if info == 26:
+            return struct.unpack(">f", bytes(buf[pos:pos + 4]))[0], pos + 4
+        if info == 27:
+            return struct.unpack(">d", bytes(buf[pos:pos + 8]))[0], pos + 8
+        if info == 20:
+            return False, pos
+        if info == 21:
+            return True, pos
+        if info == 22:
+            return None, pos
+        raise DecodeError("unsupported simple value %d" % info)
+
+    val, pos = _read_uint(buf, pos, info)
+    if major == 0:
+        if is_key:
+            return (KEYS[val] if val < len(KEYS) else "key_%d" % val), pos
+        return val, pos
+    if major == 1:
+        return -1 - val, pos
+    if major in (2, 3):
+        if pos + val > len(buf):
+            raise DecodeError("truncated string")
+        raw = bytes(buf[pos:pos + val])
+        return (raw.decode("utf-8", "replace") if major == 3 else raw.hex()), pos + val
+    if major == 4:
+        items = []
+        for _ in range(val):
+            item, pos = decode_item(buf, pos)
+            items.append(item)
+        return items, pos
+    if major == 5:
+        obj = {}
+        for _ in range(val):
+            key, pos = decode_item(buf, pos, is_key=True)
+            obj[key], pos = decode_item(buf, pos)
+        return obj, pos
+    raise DecodeError("unsupported major type %d" % major)
+
+
+def decode_frames(data):
+    """Yield decoded events from a framed byte stream, resyncing on errors."""
+    pos = 0
+    while pos + 3 <= len(data):
+        if data[pos] != FRAME_SYNC:
+            pos += 1
+            continue
+        length = data[pos + 1]
+        end = pos + 2 + length
+        if end >= len(data):
+            break
+        payload = data[pos + 2:end]
+        if sum(payload) & 0xFF != data[end]:
+            pos += 1
+            continue
+        try:
+            event, _ = decode_item(payload)
+        except DecodeError:
+            pos += 1
+            continue
+        yield event
+        pos = end + 1
+    return pos
+
+
+def decode_raw(data):
+    pos = 0
+    while pos < len(data):
+        event, pos = decode_item(data, pos)
+        yield event
+
+
+def stream_port(port, baud):
+    import serial  # pylint: disable=import-outside-toplevel
+
+    pending = bytearray()
+    with serial.Serial(port, baud, timeout=1) as link:
+        while True:
+            pending += link.read(link.in_waiting or 1)
+            frames = decode_frames(pending)
+            while True:
+                try:
+                    print(json.dumps(next(frames)), flush=True)
+                except StopIteration as done:
+                    del pending[:done.value or 0]
+                    break
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("file", nargs="?", help="capture file, stdin if omitted")
+    parser.add_argument("--port", help="serial port to read from")
+    parser.add_argument("--baud", type=int, default=9600)
+    parser.add_argument("--raw", action="store_true", help="input is unframed CBOR")
+    args = parser.parse_args()
+
+    if args.port:
+        stream_port(args.port, args.baud)
+        return
+
+    if args.file:
+        with open(args.file, "rb") as f:
+            data = f.read()
+    else:
+        data = sys.stdin.buffer.read()
+
+    events = decode_raw(data) if args.raw else decode_frames(data)
+    for event in events:
+        print(json.dumps(event))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,305 @@
+/*
+ * Replays RSSI traces through a simplified signal start / end logic of the
+ * receiver with different RSSI floor estimators, which is how
+ * NOISE_FLOOR_PERCENTILE, NOISE_FLOOR_STEP and NOISE_FLOOR_MAX_SIGNAL were
+ * chosen.
+ *
+ * A trace has one sample per millisecond, like the receiver loop.  Without
+ * arguments synthetic traces are generated: a floor of -100 dBm stepping to
+ * -90 dBm at 60 s, -104 dBm at 120 s and back to -100 dBm at 150 s, with
+ * 80 ms sensor bursts at -55 dBm every 1 to 7 s, once with a quiet floor and
+ * once with a noisier floor and a strong short interferer between 20 and
+ * 50 s.  A captured trace is replayed with
+ *
+ *     noise_floor_replay trace.txt
+ *
+ * where every line is "rssi burst", the RSSI in dBm and 1 when the sample
+ * belongs to a transmission that should be received, else 0.
+ *
+ * For every estimator the output lists signals started without a burst in
+ * them (false starts), bursts no signal covered (missed) and, for synthetic
+ * traces, the seconds until the threshold settled within 1 dB of the ideal
+ * one after boot and after each floor step.
+ *
+ * Build with
+ *
+ *     g++ -std=c++17 -O2 -o noise_floor_replay noise_floor_replay.cpp
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#define RSSI_THRESHOLD 9      // As in rtl_433_ESP.h
+#define MINRSSI        -110
+#define SEGMENTS       4      // Boot and the three floor steps of a synthetic trace
+
+struct Trace {
+  std::vector<int> rssi;
+  std::vector<char> burst;
+  std::vector<double> floor;  // Empty for a captured trace
+};
+
+static int segment(int ms) {
+  return ms < 60000 ? 0 : ms < 120000 ? 1 : ms < 150000 ? 2 : 3;
+}
+
+static Trace synthetic(int seconds, unsigned seed, double sigma, bool interferer) {
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> noise(0, sigma);
+  const double floors[SEGMENTS] = {-100, -90, -104, -100};
+  Trace t;
+  int n = seconds * 1000;
+  int nextBurst = 2000 + rng() % 3000;
+
+  t.rssi.resize(n);
+  t.burst.assign(n, 0);
+  t.floor.resize(n);
+  for (int i = 0; i < n; i++) {
+    double x;
+
+    t.floor[i] = floors[segment(i)];
+    x = t.floor[i] + noise(rng);
+    if (i >= nextBurst && i < nextBurst + 80) {
+      x = std::max(x, -55.0 + noise(rng));
+      t.burst[i] = 1;
+    }
+    if (i == nextBurst + 80)
+      nextBurst = i + 1000 + rng() % 6000;
+    // Strong, frequent and short
+    if (interferer && (i / 200) % 10 < 3 && i > 20000 && i < 50000)
+      x = std::max(x, -72.0 + noise(rng));
+    // The CC1101 reports RSSI in 0.5 dB steps
+    t.rssi[i] = (int)(std::floor(x * 2) / 2);
+  }
+  return t;
+}
+
+static bool captured(const char* name, Trace& t) {
+  FILE* f = fopen(name, "r");
+  int rssi, burst;
+
+  if (!f)
+    return false;
+  while (fscanf(f, "%d %d", &rssi, &burst) == 2) {
+    t.rssi.push_back(rssi);
+    t.burst.push_back(burst != 0);
+  }
+  fclose(f);
+  return !t.rssi.empty();
+}
+
+struct Estimator {
+  virtual ~Estimator() {}
+  virtual void sample(int rssi, bool signal, long signalMs) = 0;
+  virtual bool ready() = 0;
+  virtual int floor() = 0;
+};
+
+// The estimator replaced, an average over RSSI_SAMPLES samples signals included
+struct Average : Estimator {
+  long sum = 0;
+  int count = 0, average = 0, samples;
+  bool done = false;
+  Average(int samples) : samples(samples) {}
+  void sample(int rssi, bool, long) override {
+    sum += rssi;
+    if (++count > samples) {
+      average = sum / count;
+      sum = 0;
+      count = 0;
+      done = true;
+    }
+  }
+  bool ready() override { return done; }
+  int floor() override { return average; }
+};
+
+// Same arithmetic as rtl_433_ESP::_updateNoiseFloor(), in 1/256 dB
+struct Percentile : Estimator {
+  int32_t estimate = 0, remainder = 0;
+  bool started = false;
+  int percentile, step;
+  long maxSignalMs;
+  Percentile(int percentile, int step, long maxSignalMs)
+      : percentile(percentile), step(step), maxSignalMs(maxSignalMs) {}
+  void sample(int rssi, bool signal, long signalMs) override {
+    int32_t x = rssi * 256;
+    if (signal && signalMs <= maxSignalMs)
+      return;
+    if (!started) {
+      estimate = x;
+      started = true;
+    } else if (x < estimate) {
+      remainder -= step * (100 - percentile);
+    } else if (x > estimate) {
+      remainder += step * percentile;
+    }
+    estimate += remainder / 100;
+    remainder %= 100;
+  }
+  bool ready() override { return started; }
+  int floor() override { return (estimate + 128) >> 8; }
+};
+
+// Exponential average of the samples between signals, weight 1 / 2^shift
+struct Ewma : Estimator {
+  int32_t mean = 0;
+  bool started = false;
+  int shift;
+  long maxSignalMs;
+  Ewma(int shift, long maxSignalMs) : shift(shift), maxSignalMs(maxSignalMs) {}
+  void sample(int rssi, bool signal, long signalMs) override {
+    int32_t x = rssi * 256;
+    if (signal && signalMs <= maxSignalMs)
+      return;
+    if (!started) {
+      mean = x;
+      started = true;
+    } else {
+      mean += (x - mean) >> shift;
+    }
+  }
+  bool ready() override { return started; }
+  int floor() override { return (mean + 128) >> 8; }
+};
+
+struct Result {
+  int falseStarts = 0, missed = 0, bursts = 0;
+  double settled[SEGMENTS] = {-1, -1, -1, -1};  // s, -1 if never
+};
+
+static Result replay(const Trace& t, Estimator& e) {
+  Result res;
+  int n = t.rssi.size();
+  int threshold = MINRSSI;
+  bool signal = false, burstSeen = false, inRange = false;
+  long signalStart = 0;
+  int seg = -1, segStart = 0;
+  std::vector<char> covered(n, 0);
+
+  for (int i = 0; i < n; i++) {
+    e.sample(t.rssi[i], signal, signal ? i - signalStart : 0);
+    if (e.ready())
+      threshold = std::max(e.floor() + RSSI_THRESHOLD, MINRSSI);
+
+    if (!t.floor.empty()) {
+      int ideal = std::max((int)t.floor[i] + RSSI_THRESHOLD, MINRSSI);
+      if (segment(i) != seg) {
+        seg = segment(i);
+        segStart = i;
+        inRange = false;
+      }
+      if (!inRange && std::abs(threshold - ideal) <= 1) {
+        inRange = true;
+        res.settled[seg] = (i - segStart) / 1000.0;
+      } else if (inRange && std::abs(threshold - ideal) > 2) {
+        inRange = false;
+        res.settled[seg] = -1;
+      }
+    }
+
+    if (t.rssi[i] > threshold) {
+      if (!signal) {
+        signal = true;
+        signalStart = i;
+        burstSeen = false;
+      }
+    } else if (signal) {
+      signal = false;
+      if (!burstSeen)
+        res.falseStarts++;
+    }
+    if (signal && t.burst[i]) {
+      burstSeen = true;
+      covered[i] = 1;
+    }
+  }
+
+  for (int i = 0; i < n; i++) {
+    if (t.burst[i] && (i == 0 || !t.burst[i - 1])) {
+      bool seen = false;
+      res.bursts++;
+      for (int j = i; j < n && t.burst[j]; j++)
+        seen |= covered[j];
+      if (!seen)
+        res.missed++;
+    }
+  }
+  return res;
+}
+
+int main(int argc, char** argv) {
+  struct Candidate {
+    const char* name;
+    std::function<Estimator*()> make;
+  };
+  const std::vector<Candidate> candidates = {
+      {"average 50000 (old)", [] { return (Estimator*)new Average(50000); }},
+      {"ewma 1/1024", [] { return (Estimator*)new Ewma(10, 500); }},
+      {"p20 step 8", [] { return (Estimator*)new Percentile(20, 8, 500); }},
+      {"p20 step 16", [] { return (Estimator*)new Percentile(20, 16, 500); }},
+      {"p50 step 4", [] { return (Estimator*)new Percentile(50, 4, 500); }},
+      {"p50 step 8 (default)", [] { return (Estimator*)new Percentile(50, 8, 500); }},
+      {"p50 step 16", [] { return (Estimator*)new Percentile(50, 16, 500); }},
+      {"p50 step 8, no max", [] { return (Estimator*)new Percentile(50, 8, 1L << 30); }},
+  };
+  std::vector<std::pair<std::string, std::vector<Trace>>> sets;
+
+  if (argc > 1) {
+    Trace t;
+    if (!captured(argv[1], t)) {
+      fprintf(stderr, "Cannot read a trace from %s\n", argv[1]);
+      return 1;
+    }
+    sets.push_back({argv[1], {t}});
+  } else {
+    for (int noisy = 0; noisy < 2; noisy++) {
+      std::vector<Trace> traces;
+      for (unsigned seed = 1; seed <= 5; seed++)
+        traces.push_back(synthetic(200, seed * 7 + noisy, noisy ? 3 : 2, noisy));
+      sets.push_back({noisy ? "sigma 3 dB, interferer" : "sigma 2 dB", traces});
+    }
+  }
+
+  for (auto& set : sets) {
+    printf("== %s, RSSI_THRESHOLD %d\n", set.first.c_str(), RSSI_THRESHOLD);
+    for (auto& c : candidates) {
+      int falseStarts = 0, missed = 0, bursts = 0;
+      double settled[SEGMENTS] = {0};
+      int settledCount[SEGMENTS] = {0};
+      std::string times;
+
+      for (auto& t : set.second) {
+        Estimator* e = c.make();
+        Result r = replay(t, *e);
+        delete e;
+        falseStarts += r.falseStarts;
+        missed += r.missed;
+        bursts += r.bursts;
+        for (int k = 0; k < SEGMENTS; k++) {
+          if (r.settled[k] >= 0) {
+            settled[k] += r.settled[k];
+            settledCount[k]++;
+          }
+        }
+      }
+      if (!set.second[0].floor.empty()) {
+        for (int k = 0; k < SEGMENTS; k++) {
+          char s[16];
+          if (settledCount[k])
+            snprintf(s, sizeof(s), " %6.2f", settled[k] / settledCount[k]);
+          else
+            snprintf(s, sizeof(s), " %6s", "never");
+          times += s;
+        }
+      }
+      printf("%-22s false starts %5d  missed %3d/%-3d%s%s\n", c.name, falseStarts, missed, bursts,
+             times.empty() ? "" : "  settled s (boot, up, down, back)", times.c_str());
+    }
+  }
+  return 0;
+}
@@ -28,20 +28,9 @@
 static  const uint8_t 	 monthDays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31}; // API starts months from 1, this array starts from 0
 #endif 
 
-bool check(uint8_t *pRecord, void *pData) {
-
-  Alarm a;
-
-  memcpy(&a, pRecord, sizeof(a));
-
-  if (strcmp(a.id, (char *)pData) == 0)
-    return true;
-
-  return false;
-}
-
 #endif
 
+AMController *AMController::_instance = NULL;
 
 AMController::AMController(
   void (*doWork)(void),
@@ -62,6 +51,43 @@ AMController::AMController(
 
   _connected = false;
   _connectionChanged = false;
+
+  _outQueue = NULL;
+  _writerTask = NULL;
+  _congested = false;
+  _droppedMessages = 0;
+  _outLock = portMUX_INITIALIZER_UNLOCKED;
+  _outOwner = NULL;
+  _outSenders = 0;
+  _mtu = DEFAULT_MTU;
+  _notifications = 0;
+
+  _dataAvailable = false;
+  _rxHead = 0;
+  _rxTail = 0;
+  _rxDropping = false;
+  _rxResync = false;
+  _droppedCommands = 0;
+  resetParser();
+
+#ifdef SD_SUPPORT
+  _streamQueue = NULL;
+  _streamTask = NULL;
+  _streaming = false;
+  _streamSize = 0;
+  _streamRead = 0;
+  _streamStart = 0;
+  _streamTime = 0;
+#endif
+
+#ifdef SDLOGGEDATAGRAPH_SUPPORT
+  for (int i = 0; i < LOG_FILES; i++) {
+    _logFiles[i].variable[0] = '\0';
+    _logFiles[i].length = 0;
+  }
+  _logSamples = 0;
+  _logWrites = 0;
+#endif
 }
 
 #if defined(ALARMS_SUPPORT)
@@ -81,6 +107,8 @@ AMController::AMController(
   _processAlarms = processAlarms;
   _lastAlarmCheck = 0;
 	_startTime = 0;
+  _alarmCount = 0;
+  _alarmsLoaded = false;
 }
 #endif
 
@@ -92,6 +120,40 @@ void AMController::begin(const char *deviceName) {
 #endif
 
   BLEDevice::init(deviceName);
+  BLEDevice::setMTU(BLE_MTU);
+
+  // Outbound messages are notified by their own task, so callers never wait on BLE
+  _instance = this;
+  BLEDevice::setCustomGattsHandler(&AMController::gattsEvent);
+
+  if (_outQueue == NULL) {
+    _outQueue = xQueueCreate(OUTBOUND_QUEUE_LENGTH, sizeof(OutboundMessage));
+
+    xTaskCreatePinnedToCore(
+        &AMController::writerTask, /* Function to implement the task */
+        "AMControllerWriter", /* Name of the task */
+        WRITER_TASK_STACK, /* Stack size in bytes */
+        this, /* Task input parameter */
+        WRITER_TASK_PRIORITY, /* Priority of the task */
+        &_writerTask, /* Task handle. */
+        WRITER_TASK_CORE); /* Core where the task should run */
+  }
+
+#ifdef SD_SUPPORT
+  // Files are read and queued by their own task, so downloads do not hold up loop()
+  if (_streamQueue == NULL) {
+    _streamQueue = xQueueCreate(STREAM_QUEUE_LENGTH, sizeof(StreamRequest));
+
+    xTaskCreatePinnedToCore(
+        &AMController::streamTask, /* Function to implement the task */
+        "AMControllerStream", /* Name of the task */
+        STREAM_TASK_STACK, /* Stack size in bytes */
+        this, /* Task input parameter */
+        STREAM_TASK_PRIORITY, /* Priority of the task */
+        &_streamTask, /* Task handle. */
+        STREAM_TASK_CORE); /* Core where the task should run */
+  }
+#endif
 
   _pServer = BLEDevice::createServer();
   _pServerCallbacks = new ConnectionCallbacks(this);
@@ -167,6 +229,10 @@ void AMController::loop(unsigned long _delay) {
 
       if (_deviceDisconnected != NULL)
         _deviceDisconnected();
+
+      // Nobody to deliver to
+      xQueueReset(_outQueue);
+      _congested = false;
         
       _pServer->startAdvertising();
     }
@@ -195,6 +261,10 @@ void AMController::loop(unsigned long _delay) {
 
 #endif
 
+#ifdef SDLOGGEDATAGRAPH_SUPPORT
+  this->flushExpiredLogs();
+#endif
+
   _doWork();
 
   if (_connected)
@@ -204,186 +274,359 @@ void AMController::loop(unsigned long _delay) {
 }
 
 
+/*
+  FNV-1a hash of a command name, computed at compile time for the command
+  table and byte by byte by the parser
+*/
+#define COMMAND_HASH_OFFSET 2166136261u
+#define COMMAND_HASH_PRIME  16777619u
+
+static constexpr uint32_t commandHash(const char *name, uint32_t hash = COMMAND_HASH_OFFSET) {
+  return *name ? commandHash(name + 1, (hash ^ (uint8_t)*name) * COMMAND_HASH_PRIME) : hash;
+}
+
+#define COMMAND(NAME, HANDLER, FLAGS) { commandHash(NAME), NAME, &AMController::HANDLER, FLAGS }
+
+const AMController::CommandEntry AMController::_commands[] = {
+  COMMAND("Sync", commandSync, COMMAND_NEEDS_VALUE | COMMAND_FORWARD),
+#ifdef ALARMS_SUPPORT
+  COMMAND("$AlarmId$", commandAlarmId, COMMAND_NEEDS_VALUE | COMMAND_FORWARD),
+  COMMAND("$AlarmT$", commandAlarmTime, COMMAND_NEEDS_VALUE | COMMAND_FORWARD),
+  COMMAND("$AlarmR$", commandAlarmRepeat, COMMAND_NEEDS_VALUE | COMMAND_FORWARD),
+  COMMAND("$Time$", commandTime, COMMAND_NEEDS_VALUE),
+#endif
+#ifdef SD_SUPPORT
+  COMMAND("SD", commandSdList, COMMAND_FORWARD),
+  COMMAND("$SDDL$", commandSdDownload, COMMAND_FORWARD),
+#endif
+#ifdef SDLOGGEDATAGRAPH_SUPPORT
+  COMMAND("$SDLogData$", commandLogData, COMMAND_NEEDS_VALUE),
+#endif
+  { 0, NULL, NULL, 0 }
+};
+
+void AMController::resetParser() {
+
+  _parseState = PARSE_VARIABLE;
+  _variableLength = 0;
+  _valueLength = 0;
+  _variableHash = COMMAND_HASH_OFFSET;
+}
+
+/**
+	Parse the bytes received since the last call. Each var=value# pair is
+	dispatched once, as soon as its # arrives.
+**/
 void AMController::processIncomingData() {
 
-  char      _variable[VARIABLELEN + 1];
-  char      _value[VALUELEN + 1];
-  bool      _var = true;
-  uint8_t   _idx = 0;
-  int	   		lastPound = -1;
+  while (_rxTail != _rxHead) {
+    uint8_t c = _rxBuffer[_rxTail & (RX_BUFFER_SIZE - 1)];
+    _rxTail++;
 
-  _variable[0] = '\0';
-  _value[0] = '\0';
+    parseByte(c);
+  }
+}
 
-  uint8_t l = strlen(_remainBuffer);
+void AMController::parseByte(uint8_t c) {
 
-  //Serial.print("Full buffer before >"); Serial.print(_remainBuffer); Serial.println("<");
+  if (c == RX_RESYNC) {
+    resetParser();
+    return;
+  }
 
-  for (uint8_t i = 0; i < l; i++) {
+  switch (_parseState) {
 
-    if (_var) {
-      if (_remainBuffer[i] != '=') {
-        _variable[_idx++] = _remainBuffer[i];
+    case PARSE_VARIABLE:
+      if (c == '=') {
+        _variable[_variableLength] = '\0';
+        _parseState = PARSE_VALUE;
+      }
+      else if (c == '#') {
+        resetParser();
+      }
+      else if (_variableLength < VARIABLELEN) {
+        _variable[_variableLength++] = c;
+        _variableHash = (_variableHash ^ c) * COMMAND_HASH_PRIME;
       }
       else {
-        _variable[_idx] = '\0';
-        _var = false;
-        _idx = 0;
+        _droppedCommands++;
+        _parseState = PARSE_SKIP;
       }
-    }
-    else {
-      if (_remainBuffer[i] == '#') {
-        lastPound = i;
+      break;
+
+    case PARSE_VALUE:
+      if (c == '#') {
+        _value[_valueLength] = '\0';
+        dispatchCommand();
+        resetParser();
       }
-      if (_remainBuffer[i] != '#') {
-        _value[_idx++] = _remainBuffer[i];
+      else if (_valueLength < VALUELEN) {
+        _value[_valueLength++] = c;
       }
       else {
-        _value[_idx] = '\0';
-        _var = true;
-        _idx = 0;
+        _droppedCommands++;
+        _parseState = PARSE_SKIP;
+      }
+      break;
+
+    case PARSE_SKIP:
+      if (c == '#')
+        resetParser();
+      break;
+  }
+}
+
+void AMController::dispatchCommand() {
+
+  const CommandEntry *command = NULL;
+  bool hasValue = _valueLength > 0;
+
+  for (const CommandEntry *entry = _commands; entry->name != NULL; entry++) {
+    if (entry->hash == _variableHash && strcmp(entry->name, _variable) == 0) {
+      command = entry;
+      break;
+    }
+  }
+
+  if (command != NULL && (hasValue || !(command->flags & COMMAND_NEEDS_VALUE))) {
+    (this->*command->handler)(_value);
+  }
+
+  if (_variableLength > 0 && hasValue && (command == NULL || (command->flags & COMMAND_FORWARD))) {
+    // Process incoming messages
+#ifdef DEBUG
+    Serial.print("process "); Serial.print(_variable); Serial.print(" -> "); Serial.println(_value);
+#endif
+    _processIncomingMessages(_variable, _value);
+  }
+}
+
+void AMController::commandSync(char *value) {
+
+  _sync = true;
+}
 
-        if (strlen(_value) > 0 && strcmp(_variable, "Sync") == 0) {
-          _sync = true;
-        }
 #ifdef ALARMS_SUPPORT
-        else if (strcmp(_variable, "$AlarmId$") == 0 && strlen(_value) > 0) {
-Serial.print("AlarmId "); Serial.print(_value);
-          strcpy(_alarmId, _value);
-        } else if (strcmp(_variable, "$AlarmT$") == 0 && strlen(_value) > 0) {
-Serial.print("AlarmT "); Serial.print(_value);
-          _alarmTime = atol(_value);
-        }
-        else if (strcmp(_variable, "$AlarmR$") == 0 && strlen(_value) > 0) {
-Serial.print("AlarmR "); Serial.print(_value);
-          if (_alarmTime == 0)
-            this->removeAlarm(_alarmId);
-          else
-            this->createUpdateAlarm(_alarmId, _alarmTime, atoi(_value));
-        }
+
+void AMController::commandAlarmId(char *value) {
+#ifdef DEBUG
+  Serial.print("AlarmId "); Serial.println(value);
 #endif
-#ifdef SD_SUPPORT
-        else if (strlen(_variable) > 0 && strcmp(_variable, "SD") == 0) {
-          File root;
-          File entry;
+  snprintf(_alarmId, sizeof(_alarmId), "%s", value);
+}
+
+void AMController::commandAlarmTime(char *value) {
+#ifdef DEBUG
+  Serial.print("AlarmT "); Serial.println(value);
+#endif
+  _alarmTime = atol(value);
+}
+
+void AMController::commandAlarmRepeat(char *value) {
 #ifdef DEBUG
-          Serial.println("List of Files");
+  Serial.print("AlarmR "); Serial.println(value);
 #endif
-          root = SD.open("/");
-          if (!root) {
-#ifdef DEBUG          
-            Serial.println("Cannot open root dir");
-#endif            
-          }          
-          root.rewindDirectory();
-          entry =  root.openNextFile();
-          if (!entry) {
-#ifdef DEBUG          
-            Serial.println("Cannot open first file");
+  if (_alarmTime == 0)
+    this->removeAlarm(_alarmId);
+  else
+    this->createUpdateAlarm(_alarmId, _alarmTime, atoi(value));
+}
+
+void AMController::commandTime(char *value) {
+#ifdef DEBUG
+  Serial.print("Setting time at value: "); Serial.println(atol(value));
 #endif
-          }
-          while (entry) {          
-            if (!entry.isDirectory()) {
-	            String name = entry.name();
-#ifdef DEBUG	            
-              Serial.println(name);
-#endif              
-              this->writeTxtMessage("SD", name.c_str());
-            }
-            entry.close();
-            entry = root.openNextFile();
-          }
-          root.close();
-          this->writeTxtMessage("SD", "$EFL$");
-#ifdef DEBUG          
-          Serial.println("File list sent");
-#endif          
-        }
-        else if (strlen(_variable) > 0 && strcmp(_variable, "$SDDL$") == 0) {
-#ifdef DEBUG        
-          Serial.print("File: "); Serial.println(_value);
-#endif          
-          String fileName = String(_value);
-          fileName = "/" + fileName;
-          File entry = SD.open(fileName.c_str(), FILE_READ);
-
-          if (entry) {
-#ifdef DEBUG          
-            Serial.println("File Opened");
-#endif            
-            unsigned long n = 0;
-            uint8_t buffer[64];
-						this->writeTxtMessage("SD", "$C$");
-
-            while (entry.available()) {
-              n = entry.read(buffer, sizeof(buffer));
-              writeBuffer(buffer, n * sizeof(uint8_t));
-            }
-            entry.close();
-#ifdef DEBUG            
-            Serial.println("File completed");
-#endif            
-            this->writeTxtMessage("SD", "$E$");
-#ifdef DEBUG            
-            Serial.println("End Sent");
-#endif            
-          }
-        }
+  _startTime = atol(value) - millis() / 1000;
+#ifdef DEBUG
+  Serial.print("Time Synchronized "); this->printTime(now()); Serial.println();
 #endif
-        if (strlen(_variable) > 0 && strlen(_value) > 0) {
-#ifdef ALARMS_SUPPORT
-          if (strcmp(_variable, "$Time$") == 0) {
-            Serial.print("Setting time at value: "); Serial.println(atol(_value));
-            _startTime = atol(_value) - millis() / 1000;
-#ifdef DEBUG            
-            Serial.print("Time Synchronized "); this->printTime(now()); Serial.println();
-#endif            
-          }
-          else
+}
+
+#endif
+
+#ifdef SD_SUPPORT
+
+void AMController::commandSdList(char *value) {
+#ifdef DEBUG
+  Serial.println("List of Files");
 #endif
+  requestStream(STREAM_LIST, "");
+}
+
+void AMController::commandSdDownload(char *value) {
+#ifdef DEBUG
+  Serial.print("File: "); Serial.println(value);
+#endif
+  requestStream(STREAM_DOWNLOAD, value);
+}
+
+/**
+	Queue a file for the stream task, false if too many are waiting
+**/
+bool AMController::requestStream(uint8_t type, const char *name) {
+  StreamRequest request;
+
+  if (_streamQueue == NULL) {
+    return false;
+  }
+
+  request.type = type;
+  strncpy(request.name, name, VALUELEN);
+  request.name[VALUELEN] = '\0';
+
+  return xQueueSend(_streamQueue, &request, 0) == pdTRUE;
+}
+
+/**
+	Send files and file lists requested with $SDDL$, $SDLogData$ or SD, off the
+	loop() that received the request. A file is read in
+	STREAM_BLOCK_SIZE blocks and framed into the outbound queue, which is
+	drained by the writer task, so reading the next block from SD overlaps
+	with notifying the previous one.
+**/
+void AMController::streamTask(void *pController) {
+  AMController  *controller = (AMController *)pController;
+  StreamRequest request;
+
+  for (;;) {
+    if (xQueueReceive(controller->_streamQueue, &request, portMAX_DELAY) != pdTRUE)
+      continue;
+
+    controller->_streamSize = 0;
+    controller->_streamRead = 0;
+    controller->_streamStart = millis();
+    controller->_streaming = true;
+
 #ifdef SDLOGGEDATAGRAPH_SUPPORT
-            if (strlen(_variable) > 0 && strcmp(_variable, "$SDLogData$") == 0) {
-              Serial.print("Logged data request for: "); Serial.println(_value);
-              sdSendLogData(_value);
-            }
-            else
+    if (request.type == STREAM_LOG_DATA)
+      controller->streamLogData(request.name);
+    else
 #endif
-            {
-              // Process incoming messages
-#ifdef DEBUG                
-              Serial.print("process "); Serial.print(_variable); Serial.print(" -> "); Serial.println(_value);
-#endif              
-              _processIncomingMessages(_variable, _value);
-            }
-        }
-      }
-    }
+    if (request.type == STREAM_LIST)
+      controller->streamList();
+    else
+      controller->streamDownload(request.name);
+
+    controller->_streamTime = millis() - controller->_streamStart;
+    controller->_streaming = false;
   }
+}
 
-  if (lastPound == l - 1) {
-    _remainBuffer[0] = '\0';
+void AMController::streamDownload(const char *name) {
+
+  char fileName[VALUELEN + 2];
+
+  snprintf(fileName, sizeof(fileName), "/%s", name);
+
+  File entry = SD.open(fileName, FILE_READ);
+
+  if (!entry) {
+#ifdef DEBUG
+    Serial.print("Error opening "); Serial.println(fileName);
+#endif
+    return;
   }
-  else if (lastPound > 0) {
-    char tmp[128];
-    strcpy(tmp, &_remainBuffer[lastPound + 1]);
-    strcpy(_remainBuffer, tmp);
+
+#ifdef DEBUG
+  Serial.println("File Opened");
+#endif
+  _streamSize = entry.size();
+  claimOutbound();
+  this->sendTxtMessage("SD", "$C$", portMAX_DELAY);
+
+  while (_connected) {
+    size_t n = entry.read(_streamBlock, STREAM_BLOCK_SIZE);
+
+    if (n == 0)
+      break;
+
+    writeBuffer(_streamBlock, n);
+    _streamRead += n;
+  }
+  entry.close();
+#ifdef DEBUG
+  Serial.println("File completed");
+#endif
+  this->sendTxtMessage("SD", "$E$", portMAX_DELAY);
+  releaseOutbound();
+#ifdef DEBUG
+  Serial.println("End Sent");
+#endif
+}
+
+void AMController::streamList() {
+  File root;
+  File entry;
+  root = SD.open("/");
+  if (!root) {
+#ifdef DEBUG
+    Serial.println("Cannot open root dir");
+#endif
+  }
+  root.rewindDirectory();
+  entry =  root.openNextFile();
+  if (!entry) {
+#ifdef DEBUG
+    Serial.println("Cannot open first file");
+#endif
+  }
+  while (entry) {
+    if (!entry.isDirectory()) {
+      String name = entry.name();
+#ifdef DEBUG
+      Serial.println(name);
+#endif
+      this->sendTxtMessage("SD", name.c_str(), portMAX_DELAY);
+    }
+    entry.close();
+    entry = root.openNextFile();
   }
+  root.close();
+  this->sendTxtMessage("SD", "$EFL$", portMAX_DELAY);
+#ifdef DEBUG
+  Serial.println("File list sent");
+#endif
+}
+
+bool AMController::streaming() {
+  return _streaming;
+}
+
+unsigned long AMController::streamSize() {
+  return _streamSize;
+}
+
+unsigned long AMController::streamProgress() {
+  return _streamRead;
+}
+
+unsigned long AMController::streamRate() {
+  unsigned long elapsed = _streaming ? millis() - _streamStart : _streamTime;
+
+  return elapsed > 0 ? (unsigned long)((uint64_t)_streamRead * 1000 / elapsed) : 0;
+}
 
-#ifdef DEBUG 
-  Serial.print("Full buffer after  >"); Serial.print(_remainBuffer); Serial.println("<");
-#endif  
+#endif
+
+#ifdef SDLOGGEDATAGRAPH_SUPPORT
+
+void AMController::commandLogData(char *value) {
+#ifdef DEBUG
+  Serial.print("Logged data request for: "); Serial.println(value);
+#endif
+  sdSendLogData(value);
 }
 
+#endif
+
 void AMController::writeMessage(const char *variable, int value) {
-char buffer[128];
+  char buffer[128];
 
   if (!_connected) {
     return;
   }
-  memset(&buffer, 0, 128);
   snprintf(buffer, 128, "%s=%d#", variable, value);
-  writeBuffer((uint8_t *)&buffer, strlen(buffer));
-  delay(WRITE_DELAY);
+  enqueue((uint8_t *)&buffer, strlen(buffer), 0);
 }
 
 void AMController::writeMessage(const char *variable, float value) {
@@ -392,11 +635,8 @@ void AMController::writeMessage(const char *variable, float value) {
   if (!_connected) {
     return;
   }
-  memset(&buffer, 0, 128);
   snprintf(buffer, 128, "%s=%.3f#", variable, value);
-  _pCharacteristic->setValue((uint8_t *)&buffer, strlen(buffer));
-  _pCharacteristic->notify();
-  delay(WRITE_DELAY);
+  enqueue((uint8_t *)&buffer, strlen(buffer), 0);
 }
 
 void AMController::writeTripleMessage(const char *variable, float vX, float vY, float vZ) {
@@ -406,53 +646,248 @@ void AMController::writeTripleMessage(const char *variable, float vX, float vY,
     return;
   }
   snprintf(buffer, VARIABLELEN + VALUELEN + 3, "%s=%.2f:%.2f:%.2f#", variable, vX, vY, vZ);
-  writeBuffer((uint8_t *)&buffer, strlen(buffer)*sizeof(char));
-  delay(WRITE_DELAY);
+  enqueue((uint8_t *)&buffer, strlen(buffer)*sizeof(char), 0);
 }
 
 void AMController::writeTxtMessage(const char *variable, const char *value) {
+
+  this->sendTxtMessage(variable, value, 0);
+}
+
+/**
+	writeTxtMessage() that reports a message it could not queue, see tryWriteBuffer()
+**/
+bool AMController::tryWriteTxtMessage(const char *variable, const char *value) {
+  char buffer[128];
+
+  snprintf(buffer, 128, "%s=%s#", variable, value);
+  return tryWriteBuffer((uint8_t *)&buffer, strlen(buffer));
+}
+
+void AMController::sendTxtMessage(const char *variable, const char *value, TickType_t wait) {
  char buffer[128];
 
   if (!_connected) {
     return;
   }
-  memset(&buffer, 0, 128);
   snprintf(buffer, 128, "%s=%s#", variable, value);
-  writeBuffer((uint8_t *)&buffer, strlen(buffer));
-  delay(WRITE_DELAY);
+  enqueue((uint8_t *)&buffer, strlen(buffer), wait);
 }
 
-
 /**
-	Can send a buffer longer than 20 bytes
+	Can send a buffer of any length, waits for room in the outbound queue
 **/
 void AMController::writeBuffer(uint8_t *buffer, int l) {
-  uint8_t buffer1[22];
 
   if (!_connected) {
     return;
   }
 
-  uint8_t idx = 0;
+  int idx = 0;
 
   while (idx < l) {
 
-    uint8_t this_block_size = min(20, l - idx);
-    memset(&buffer1, '\0', 22);
-    memcpy(&buffer1, buffer + idx, this_block_size);
+    int this_block_size = min(OUTBOUND_MESSAGE_SIZE, l - idx);
+
+    if (!enqueue(buffer + idx, this_block_size, portMAX_DELAY))
+      return;
+
+    idx += this_block_size;
+  }
+}
+
+/**
+	Queue a buffer of at most OUTBOUND_MESSAGE_SIZE bytes without waiting, for
+	callers in loop() that send more than the outbound queue holds. Returns
+	false when the queue is full or held by a raw download, so the caller can
+	retry on a later pass; nothing is counted as dropped then.
+**/
+bool AMController::tryWriteBuffer(const uint8_t *buffer, int l) {
+
+  if (!_connected) {
+    return true;
+  }
+  return enqueue(buffer, l, 0, false);
+}
+
+/**
+	Queue a message for the writer task, waiting at most wait ticks for room.
+	Messages that do not fit, or that other tasks queue while a raw download
+	owns the queue, are dropped and counted unless countDropped is false.
+**/
+bool AMController::enqueue(const uint8_t *buffer, int l, TickType_t wait, bool countDropped) {
+  OutboundMessage message;
+  bool            allowed;
+  bool            sent;
+
+  if (_outQueue == NULL || l > OUTBOUND_MESSAGE_SIZE) {
+    return false;
+  }
+
+  portENTER_CRITICAL(&_outLock);
+  allowed = _outOwner == NULL || _outOwner == xTaskGetCurrentTaskHandle();
+  if (allowed)
+    _outSenders++;
+  portEXIT_CRITICAL(&_outLock);
+
+  if (!allowed) {
+    if (countDropped)
+      _droppedMessages++;
+    return false;
+  }
+
+  message.length = l;
+  memcpy(message.data, buffer, l);
+
+  sent = xQueueSend(_outQueue, &message, wait) == pdTRUE;
+
+  portENTER_CRITICAL(&_outLock);
+  _outSenders--;
+  portEXIT_CRITICAL(&_outLock);
+
+  if (!sent) {
+    if (countDropped)
+      _droppedMessages++;
+    return false;
+  }
+  return true;
+}
+
+/**
+	Make the calling task the only one queueing messages, so nothing lands
+	between the $C$ and $E$ of a raw download. Returns once the messages other
+	tasks were queueing are in.
+**/
+void AMController::claimOutbound() {
+  int senders;
+
+  portENTER_CRITICAL(&_outLock);
+  _outOwner = xTaskGetCurrentTaskHandle();
+  portEXIT_CRITICAL(&_outLock);
+
+  for (;;) {
+    portENTER_CRITICAL(&_outLock);
+    senders = _outSenders;
+    portEXIT_CRITICAL(&_outLock);
+
+    if (senders == 0)
+      break;
+    vTaskDelay(1);
+  }
+}
+
+/**
+	Let every task queue messages again
+**/
+void AMController::releaseOutbound() {
+
+  portENTER_CRITICAL(&_outLock);
+  _outOwner = NULL;
+  portEXIT_CRITICAL(&_outLock);
+}
+
+/**
+	Send one notification. The next one goes out once the stack reports this
+	one done (ESP_GATTS_CONF_EVT) and the link is not congested, rather than
+	after a fixed delay.
+**/
+void AMController::notifyPacket(const uint8_t *buffer, int l) {
 
 #ifdef DEBUG
-    //Serial.print("Sending >"); Serial.print((char *)buffer1); Serial.print("<"); Serial.println();
+  //Serial.print("Sending "); Serial.print(l); Serial.println(" bytes");
 #endif
 
-    _pCharacteristic->setValue((uint8_t *)&buffer1, 20);
-    _pCharacteristic->notify();
-    delay(WRITE_DELAY);
+  ulTaskNotifyTake(pdTRUE, 0);
+  _pCharacteristic->setValue((uint8_t *)buffer, l);
+  _pCharacteristic->notify();
+  _notifications++;
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(WRITE_TIMEOUT));
 
-    idx += this_block_size;
+  while (_congested && _connected) {
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(WRITE_TIMEOUT)) == 0)
+      break;
   }
 }
 
+/**
+	Send a message and everything queued behind it as a byte stream cut in
+	notifications of MTU - 3 bytes, so several var=value# messages share a
+	notification.
+**/
+void AMController::sendQueued(OutboundMessage *message) {
+  uint8_t packet[BLE_MTU - 3 + OUTBOUND_MESSAGE_SIZE];
+  int     l = 0;
+
+  do {
+    memcpy(packet + l, message->data, message->length);
+    l += message->length;
+
+    int payload = _mtu - 3;
+
+    while (l >= payload && _connected) {
+      notifyPacket(packet, payload);
+      l -= payload;
+      memmove(packet, packet + payload, l);
+    }
+  } while (_connected && xQueueReceive(_outQueue, message, 0) == pdTRUE);
+
+  if (l > 0 && _connected)
+    notifyPacket(packet, l);
+}
+
+void AMController::writerTask(void *pController) {
+  AMController    *controller = (AMController *)pController;
+  OutboundMessage message;
+
+  for (;;) {
+    if (xQueueReceive(controller->_outQueue, &message, portMAX_DELAY) != pdTRUE)
+      continue;
+
+    if (controller->_connected)
+      controller->sendQueued(&message);
+  }
+}
+
+/**
+	GATT server events, in the BLE task. Wakes up the writer task when a
+	notification has been handed to the stack or the link is no longer congested.
+**/
+void AMController::gattsEvent(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param) {
+  AMController *controller = _instance;
+
+  if (controller == NULL || controller->_writerTask == NULL) {
+    return;
+  }
+
+  switch (event) {
+    case ESP_GATTS_CONF_EVT:
+      if (param->conf.handle == controller->_pCharacteristic->getHandle())
+        xTaskNotifyGive(controller->_writerTask);
+      break;
+
+    case ESP_GATTS_MTU_EVT:
+      controller->_mtu = min((uint16_t)param->mtu.mtu, (uint16_t)BLE_MTU);
+      break;
+
+    case ESP_GATTS_CONGEST_EVT:
+      controller->_congested = param->congest.congested;
+      if (!param->congest.congested)
+        xTaskNotifyGive(controller->_writerTask);
+      break;
+
+    default:
+      break;
+  }
+}
+
+unsigned long AMController::droppedMessages() {
+  return _droppedMessages;
+}
+
+unsigned long AMController::notificationsSent() {
+  return _notifications;
+}
+
 void AMController::updateBatteryLevel(uint8_t level) {
 
   if (!_connected) {
@@ -465,9 +900,6 @@ void AMController::updateBatteryLevel(uint8_t level) {
   
 	_pBLCharacteristic->setValue(&level, 1);
 	_pBLCharacteristic->notify();
-
-	 delay(WRITE_DELAY);
-	 delay(WRITE_DELAY);
 }
 
 void AMController::setDeviceName(const char *deviceName) {
@@ -632,32 +1064,204 @@ unsigned long AMController::now() {
   return now;
 }
 
-void AMController::createUpdateAlarm(char *id, unsigned long time, bool repeat) {
+/**
+  Load the alarms file into the heap, once the SD card is available
+**/
+void AMController::inizializeAlarms() {
 
   FileManager fileManager;
-  Alarm     a;
-  int     pos;
+  Alarm       a;
 
-  pos = fileManager.find(_alarmFile, (uint8_t*)&a, sizeof(a), &check, id);
+  _alarmCount = 0;
+  _alarmsLoaded = true;
 
-  if (pos > -1) {
+  migrateAlarms();
 
-    a.time = time;
-    a.repeat = repeat;
+  // Ids are then looked up through the index instead of scanning the records
+  fileManager.createIndex(_alarmFile, sizeof(Alarm), ALARM_KEY_OFFSET, ALARM_KEY_LENGTH);
+  fileManager.find(_alarmFile, (uint8_t *)&a, sizeof(a), &loadAlarm, this);
+
+  for (int i = _alarmCount / 2 - 1; i >= 0; i--)
+    siftDownAlarm(i);
+}
 
-    fileManager.update(_alarmFile, pos, (uint8_t *)&a, sizeof(a));
+/**
+  Earlier versions wrote the table as bare Alarm records, they are moved to
+  a record file
+**/
+void AMController::migrateAlarms() {
 
-#ifdef DEBUG
-    dumpAlarms();
-#endif
+  FileManager fileManager;
+  Alarm       table[MAX_ALARMS];
+  int         count = 0;
+  uint32_t    magic = 0;
+
+  File f = SD.open(_alarmFile, FILE_READ);
+
+  if (!f)
+    return;
+
+  bool bare = f.read((uint8_t *)&magic, sizeof(magic)) != sizeof(magic) || magic != RECORD_MAGIC;
+
+  if (bare && f.seek(0)) {
+
+    while (count < MAX_ALARMS && f.read((uint8_t *)&table[count], sizeof(Alarm)) == sizeof(Alarm))
+      count++;
+  }
+
+  f.close();
+
+  if (!bare)
+    return;
+
+  fileManager.deleteFile(_alarmFile);
+
+  for (int i = 0; i < count; i++)
+    fileManager.append(_alarmFile, (uint8_t *)&table[i], sizeof(Alarm));
+}
+
+/**
+  Every record goes to the heap, the scan is never stopped
+**/
+bool AMController::loadAlarm(uint8_t *pRecord, void *pData) {
+
+  AMController *controller = (AMController *)pData;
+
+  if (controller->_alarmCount < MAX_ALARMS) {
+
+    Alarm &a = controller->_alarms[controller->_alarmCount++];
+
+    memcpy(&a, pRecord, sizeof(Alarm));
+    a.id[sizeof(a.id) - 1] = '\0';
+  }
+
+  return false;
+}
+
+/**
+  Write one alarm through to its record, a few bytes rather than the table
+**/
+bool AMController::saveAlarm(Alarm &a) {
+
+  FileManager fileManager;
+  Alarm       stored;
+
+  int position = fileManager.findKey(_alarmFile, (uint8_t *)&stored, sizeof(stored),
+                                     (uint8_t *)a.id, ALARM_KEY_OFFSET, ALARM_KEY_LENGTH);
+
+  if (position < 0)
+    return fileManager.append(_alarmFile, (uint8_t *)&a, sizeof(a));
+
+  return fileManager.update(_alarmFile, position, (uint8_t *)&a, sizeof(a));
+}
+
+bool AMController::eraseAlarm(Alarm &a) {
+
+  FileManager fileManager;
+  Alarm       stored;
+
+  int position = fileManager.findKey(_alarmFile, (uint8_t *)&stored, sizeof(stored),
+                                     (uint8_t *)a.id, ALARM_KEY_OFFSET, ALARM_KEY_LENGTH);
+
+  return position < 0 || fileManager.remove(_alarmFile, position, sizeof(a));
+}
+
+int AMController::findAlarm(char *id) {
+
+  for (int i = 0; i < _alarmCount; i++) {
+
+    if (strcmp(_alarms[i].id, id) == 0)
+      return i;
+  }
+
+  return -1;
+}
+
+void AMController::siftUpAlarm(int pos) {
+
+  while (pos > 0) {
+
+    int parent = (pos - 1) / 2;
+
+    if (_alarms[parent].time <= _alarms[pos].time)
+      return;
+
+    Alarm a = _alarms[parent];
+    _alarms[parent] = _alarms[pos];
+    _alarms[pos] = a;
+    pos = parent;
+  }
+}
+
+void AMController::siftDownAlarm(int pos) {
+
+  for (;;) {
+
+    int smallest = pos;
+    int left = 2 * pos + 1;
+    int right = left + 1;
+
+    if (left < _alarmCount && _alarms[left].time < _alarms[smallest].time)
+      smallest = left;
+    if (right < _alarmCount && _alarms[right].time < _alarms[smallest].time)
+      smallest = right;
+
+    if (smallest == pos)
+      return;
+
+    Alarm a = _alarms[smallest];
+    _alarms[smallest] = _alarms[pos];
+    _alarms[pos] = a;
+    pos = smallest;
+  }
+}
+
+void AMController::removeAlarmAt(int pos) {
+
+  _alarmCount--;
+
+  if (pos == _alarmCount)
     return;
+
+  _alarms[pos] = _alarms[_alarmCount];
+  siftUpAlarm(pos);
+  siftDownAlarm(pos);
+}
+
+void AMController::createUpdateAlarm(char *id, unsigned long time, bool repeat) {
+
+  if (!_alarmsLoaded)
+    inizializeAlarms();
+
+  int   pos = findAlarm(id);
+  Alarm a;
+
+  if (pos > -1) {
+
+    _alarms[pos].time = time;
+    _alarms[pos].repeat = repeat;
+    a = _alarms[pos];
+    siftUpAlarm(pos);
+    siftDownAlarm(pos);
   }
+  else {
+
+    if (_alarmCount == MAX_ALARMS) {
+#ifdef DEBUG
+      Serial.println("Too many alarms");
+#endif
+      return;
+    }
 
-  strcpy(a.id, id);
-  a.time = time;
-  a.repeat = repeat;
+    memset(&a, 0, sizeof(a));
+    strncpy(a.id, id, sizeof(a.id) - 1);
+    a.time = time;
+    a.repeat = repeat;
+    _alarms[_alarmCount] = a;
+    siftUpAlarm(_alarmCount++);
+  }
 
-  fileManager.append(_alarmFile, (uint8_t *)&a, sizeof(a));
+  saveAlarm(a);
 
 #ifdef DEBUG
   dumpAlarms();
@@ -666,14 +1270,17 @@ void AMController::createUpdateAlarm(char *id, unsigned long time, bool repeat)
 
 void AMController::removeAlarm(char *id) {
 
-  FileManager fileManager;
-  Alarm     a;
-  int     pos;
-  pos = fileManager.find(_alarmFile, (uint8_t*)&a, sizeof(a), &check, id);
+  if (!_alarmsLoaded)
+    inizializeAlarms();
+
+  int pos = findAlarm(id);
 
   if (pos > -1) {
 
-    fileManager.remove(_alarmFile, pos, sizeof(a));
+    Alarm a = _alarms[pos];
+
+    removeAlarmAt(pos);
+    eraseAlarm(a);
   }
 
 #ifdef DEBUG
@@ -687,14 +1294,9 @@ void AMController::dumpAlarms() {
 
   Serial.println("\t----Dump Alarms -----");
 
-  FileManager fileManager;
-
-  for (int i = 0; i < MAX_ALARMS; i++) {
+  for (int i = 0; i < _alarmCount; i++) {
 
-    Alarm a;
-
-    if (!fileManager.read(_alarmFile, i, (uint8_t *)&a, sizeof(a)))
-      return;
+    Alarm &a = _alarms[i];
 
     time_t rawtime = a.time;
     struct tm *timeinfo = gmtime(&rawtime);
@@ -706,56 +1308,54 @@ void AMController::dumpAlarms() {
 }
 #endif
 
+/**
+  The heap top is the next alarm due, nothing else is looked at until it fires
+**/
 void AMController::checkAndFireAlarms() {
 
-  FileManager fileManager;
-  unsigned long now = this->now();
-
-#ifdef DEBUG
-  Serial.print("checkAndFireAlarms ");
-  this->printTime(now);
-  Serial.println();
-  this->dumpAlarms();
-#endif
-
-  for (int i = 0; i < MAX_ALARMS; i++) {
-
-    Alarm a;
-
-    if (!fileManager.read(_alarmFile, i, (uint8_t *)&a, sizeof(a)))
-      return;
+  if (!_alarmsLoaded)
+    inizializeAlarms();
 
+  unsigned long now = this->now();
+  bool changed = false;
 
+  while (_alarmCount > 0 && _alarms[0].time <= now) {
 
-    if (a.time <= now) {
+    Alarm a = _alarms[0];
 
 #ifdef DEBUG
-      Serial.print("Firing "); Serial.println(a.id);
+    Serial.print("Firing "); Serial.println(a.id);
 #endif
-      // First character of id is A and has to be removed
-      _processAlarms(a.id);
+    _processAlarms(a.id);
 
-      if (a.repeat) {
+    if (a.repeat) {
 
-        a.time += 86400; // Scheduled again tomorrow
+      // Scheduled again tomorrow, skipping the days the device was off
+      while (a.time <= now)
+        a.time += 86400;
 
-        fileManager.update(_alarmFile, i, (uint8_t *)&a, sizeof(a));
+      _alarms[0].time = a.time;
+      siftDownAlarm(0);
+      saveAlarm(a);
 #ifdef DEBUG
-        Serial.print("Alarm rescheduled at ");
-        //this->printTime(a.time);
-        Serial.println();
+      Serial.print("Alarm rescheduled at ");
+      this->printTime(a.time);
+      Serial.println();
 #endif
-      }
-      else {
-        //     Alarm removed
+    }
+    else {
+      //     Alarm removed
+      removeAlarmAt(0);
+      eraseAlarm(a);
+    }
+
+    changed = true;
+  }
 
-        fileManager.remove(_alarmFile, i, sizeof(a));
+  if (changed) {
 #ifdef DEBUG
-        this->dumpAlarms();
+    this->dumpAlarms();
 #endif
-      }
-
-    }
   }
 }
 
@@ -785,10 +1385,12 @@ void AMController::sdLogLabels(const char *variable, const char *label1, const c
 
 void AMController::sdLogLabels(const char *variable, const char *label1, const char *label2, const char *label3, const char *label4, const char *label5) {
 
-  char fileNameBuffer[VARIABLELEN + 1];
+  char fileNameBuffer[VARIABLELEN + 2];
 
-  strcpy(fileNameBuffer, "/");
-  strcat(fileNameBuffer, variable);
+  snprintf(fileNameBuffer, sizeof(fileNameBuffer), "/%s", variable);
+
+  // Buffered samples count as content
+  this->closeLog(variable);
 
   File dataFile = SD.open(fileNameBuffer, FILE_APPEND);
 
@@ -844,206 +1446,235 @@ void AMController::sdLogLabels(const char *variable, const char *label1, const c
 
 void AMController::sdLog(const char *variable, unsigned long time, float v1) {
 
-  char fileNameBuffer[VARIABLELEN + 1];
+  float values[] = { v1 };
 
-  strcpy(fileNameBuffer, "/");
-  strcat(fileNameBuffer, variable);
+  this->sdLogRow(variable, time, values, 1);
+}
 
-  File dataFile = SD.open(fileNameBuffer, FILE_APPEND);
+void AMController::sdLog(const char *variable, unsigned long time, float v1, float v2) {
 
-  if (dataFile)
-  {
-    dataFile.print(time);
-    dataFile.print(";");
-    dataFile.print(v1);
+  float values[] = { v1, v2 };
 
-    dataFile.print(";-;-;-;-");
-    dataFile.println();
+  if (time > 0)
+    this->sdLogRow(variable, time, values, 2);
+}
 
-    dataFile.flush();
-    dataFile.close();
-  }
-  else {
-#ifdef DEBUG
-    Serial.print("Error opening"); Serial.println(variable);
-#endif
-  }
+void AMController::sdLog(const char *variable, unsigned long time, float v1, float v2, float v3) {
+
+  float values[] = { v1, v2, v3 };
+
+  if (time > 0)
+    this->sdLogRow(variable, time, values, 3);
 }
 
-void AMController::sdLog(const char *variable, unsigned long time, float v1, float v2) {
+void AMController::sdLog(const char *variable, unsigned long time, float v1, float v2, float v3, float v4) {
 
-  char fileNameBuffer[VARIABLELEN + 1];
+  float values[] = { v1, v2, v3, v4 };
 
-  strcpy(fileNameBuffer, "/");
-  strcat(fileNameBuffer, variable);
+  if (time > 0)
+    this->sdLogRow(variable, time, values, 4);
+}
 
-  File dataFile = SD.open(fileNameBuffer, FILE_APPEND);
+void AMController::sdLog(const char *variable, unsigned long time, float v1, float v2, float v3, float v4, float v5) {
 
-  if (dataFile && time > 0)
-  {
-    dataFile.print(time);
-    dataFile.print(";");
-    dataFile.print(v1);
-    dataFile.print(";");
+  float values[] = { v1, v2, v3, v4, v5 };
 
-    dataFile.print(v2);
+  if (time > 0)
+    this->sdLogRow(variable, time, values, 5);
+}
 
-    dataFile.print(";-;-;-");
-    dataFile.println();
+/**
+	Buffer a time;v1;..;v5 row, unused values are -. The buffer of a log is
+	written when full, LOG_FLUSH_INTERVAL after its oldest sample, or by
+	sdFlushLog(); the file stays open in between.
+**/
+void AMController::sdLogRow(const char *variable, unsigned long time, const float *values, int count) {
 
-    dataFile.flush();
-    dataFile.close();
+  char row[128];
+  int  l = snprintf(row, sizeof(row), "%lu", time);
+
+  for (int i = 0; i < 5; i++) {
+    if (i < count)
+      l += snprintf(row + l, sizeof(row) - l, ";%.2f", values[i]);
+    else
+      l += snprintf(row + l, sizeof(row) - l, ";-");
   }
-  else {
+  l += snprintf(row + l, sizeof(row) - l, "\r\n");
+
+  LogFile *log = this->openLog(variable);
+
+  if (log == NULL) {
 #ifdef DEBUG
     Serial.print("Error opening"); Serial.println(variable);
 #endif
+    return;
   }
-}
-
-void AMController::sdLog(const char *variable, unsigned long time, float v1, float v2, float v3) {
 
-  char fileNameBuffer[VARIABLELEN + 1];
+  if (log->length + l > LOG_BUFFER_SIZE)
+    this->flushLog(log);
 
-  strcpy(fileNameBuffer, "/");
-  strcat(fileNameBuffer, variable);
+  if (log->length == 0)
+    log->firstSample = millis();
 
-  File dataFile = SD.open(fileNameBuffer, FILE_APPEND);
+  memcpy(log->buffer + log->length, row, l);
+  log->length += l;
+  _logSamples++;
+}
 
-  if (dataFile && time > 0)
-  {
-    dataFile.print(time);
-    dataFile.print(";");
-    dataFile.print(v1);
-    dataFile.print(";");
+LogFile *AMController::findLog(const char *variable) {
 
-    dataFile.print(v2);
-    dataFile.print(";");
+  for (int i = 0; i < LOG_FILES; i++) {
+    if (strcmp(_logFiles[i].variable, variable) == 0)
+      return &_logFiles[i];
+  }
+  return NULL;
+}
 
-    dataFile.print(v3);
+/**
+	Log file of variable, opened in a free slot or in place of the least
+	recently used one
+**/
+LogFile *AMController::openLog(const char *variable) {
 
-    dataFile.print(";-;-");
-    dataFile.println();
+  LogFile *log = this->findLog(variable);
 
-    dataFile.flush();
-    dataFile.close();
+  if (log != NULL) {
+    log->lastUsed = millis();
+    return log;
   }
-  else {
-#ifdef DEBUG
-    Serial.print("Error opening"); Serial.println(variable);
-#endif
+
+  log = &_logFiles[0];
+  for (int i = 0; i < LOG_FILES && log->variable[0] != '\0'; i++) {
+    if (_logFiles[i].variable[0] == '\0' || _logFiles[i].lastUsed - log->lastUsed > 0x80000000UL)
+      log = &_logFiles[i];
   }
-}
 
-void AMController::sdLog(const char *variable, unsigned long time, float v1, float v2, float v3, float v4) {
+  if (log->variable[0] != '\0')
+    this->closeLog(log->variable);
 
-  char fileNameBuffer[VARIABLELEN + 1];
+  char fileNameBuffer[VARIABLELEN + 2];
 
-  strcpy(fileNameBuffer, "/");
-  strcat(fileNameBuffer, variable);
+  snprintf(fileNameBuffer, sizeof(fileNameBuffer), "/%s", variable);
 
-  File dataFile = SD.open(fileNameBuffer, FILE_APPEND);
+  log->file = SD.open(fileNameBuffer, FILE_APPEND);
 
-  if (dataFile && time > 0)
-  {
-    dataFile.print(time);
-    dataFile.print(";");
-    dataFile.print(v1);
-    dataFile.print(";");
+  if (!log->file)
+    return NULL;
 
-    dataFile.print(v2);
-    dataFile.print(";");
+  strncpy(log->variable, variable, VARIABLELEN);
+  log->variable[VARIABLELEN] = '\0';
+  log->length = 0;
+  log->lastUsed = millis();
 
-    dataFile.print(v3);
-    dataFile.print(";");
+  return log;
+}
 
-    dataFile.print(v4);
+void AMController::flushLog(LogFile *log) {
 
-    dataFile.println(";-");
-    dataFile.println();
+  if (log->length == 0)
+    return;
 
-    dataFile.flush();
-    dataFile.close();
-  }
-  else {
-#ifdef DEBUG
-    Serial.print("Error opening"); Serial.println(variable);
-#endif
-  }
+  log->file.write((uint8_t *)log->buffer, log->length);
+  log->file.flush();
+  log->length = 0;
+  _logWrites++;
 }
 
-void AMController::sdLog(const char *variable, unsigned long time, float v1, float v2, float v3, float v4, float v5) {
+void AMController::closeLog(const char *variable) {
 
-  char fileNameBuffer[VARIABLELEN + 1];
+  LogFile *log = this->findLog(variable);
 
-  strcpy(fileNameBuffer, "/");
-  strcat(fileNameBuffer, variable);
+  if (log == NULL)
+    return;
 
-  File dataFile = SD.open(fileNameBuffer, FILE_APPEND);
+  this->flushLog(log);
+  log->file.close();
+  log->variable[0] = '\0';
+}
 
-  if (dataFile && time > 0)
-  {
-    dataFile.print(time);
-    dataFile.print(";");
-    dataFile.print(v1);
-    dataFile.print(";");
+void AMController::flushExpiredLogs() {
 
-    dataFile.print(v2);
-    dataFile.print(";");
+  for (int i = 0; i < LOG_FILES; i++) {
+    if (_logFiles[i].length > 0 && millis() - _logFiles[i].firstSample >= LOG_FLUSH_INTERVAL)
+      this->flushLog(&_logFiles[i]);
+  }
+}
 
-    dataFile.print(v3);
-    dataFile.print(";");
+void AMController::sdFlushLog() {
 
-    dataFile.print(v4);
-    dataFile.print(";");
+  for (int i = 0; i < LOG_FILES; i++) {
+    if (_logFiles[i].variable[0] != '\0')
+      this->flushLog(&_logFiles[i]);
+  }
+}
 
-    dataFile.println(v5);
+unsigned long AMController::sdLogSamples() {
+  return _logSamples;
+}
 
-    dataFile.println();
+unsigned long AMController::sdLogWrites() {
+  return _logWrites;
+}
 
-    dataFile.flush();
-    dataFile.close();
-  }
-  else {
+/**
+	Send the lines of a log file in the background, followed by an empty value
+**/
+void AMController::sdSendLogData(const char *variable) {
+
+  LogFile *log = this->findLog(variable);
+
+  if (log != NULL)
+    this->flushLog(log);
+
+  if (!requestStream(STREAM_LOG_DATA, variable)) {
 #ifdef DEBUG
-    Serial.print("Error opening"); Serial.println(variable);
+    Serial.print("Stream queue full, dropped "); Serial.println(variable);
 #endif
   }
 }
 
-void AMController::sdSendLogData(const char *variable) {
+void AMController::streamLogData(const char *variable) {
 
-  char fileNameBuffer[VARIABLELEN + 1];
+  char fileNameBuffer[VARIABLELEN + 2];
 
-  strcpy(fileNameBuffer, "/");
-  strcat(fileNameBuffer, variable);
+  snprintf(fileNameBuffer, sizeof(fileNameBuffer), "/%s", variable);
 
   File dataFile = SD.open(fileNameBuffer);
 
   if (dataFile) {
 
-    char c;
-    char buffer[128];
-    int i = 0;
+    // Room for variable=line# in an outbound message
+    char buffer[OUTBOUND_MESSAGE_SIZE - VARIABLELEN - 2];
+    size_t i = 0;
 
-    dataFile.seek(0);
+    _streamSize = dataFile.size();
 
-    while ( dataFile.available() ) {
+    while (_connected) {
 
-      c = dataFile.read();
+      size_t n = dataFile.read(_streamBlock, STREAM_BLOCK_SIZE);
 
-      if (c == '\n') {
+      if (n == 0)
+        break;
 
-        buffer[i++] = '\0';
+      for (size_t j = 0; j < n; j++) {
+
+        char c = _streamBlock[j];
+
+        if (c == '\n') {
+
+          buffer[i] = '\0';
 #ifdef DEBUG
-        Serial.println(buffer);
+          Serial.println(buffer);
 #endif
-        this->writeTxtMessage(variable, buffer);
+          this->sendTxtMessage(variable, buffer, portMAX_DELAY);
 
-        i = 0;
+          i = 0;
+        }
+        else if (i < sizeof(buffer) - 1)
+          buffer[i++] = c;
       }
-      else
-        buffer[i++] = c;
+
+      _streamRead += n;
     }
 
 #ifdef DEBUG
@@ -1058,16 +1689,20 @@ void AMController::sdSendLogData(const char *variable) {
 #endif
   }
 
-  this->writeTxtMessage(variable, "");
+  this->sendTxtMessage(variable, "", portMAX_DELAY);
 }
 
 // Size in bytes
 uint16_t AMController::sdFileSize(const char *variable) {
 
-  char fileNameBuffer[VARIABLELEN + 1];
+  char fileNameBuffer[VARIABLELEN + 2];
+
+  snprintf(fileNameBuffer, sizeof(fileNameBuffer), "/%s", variable);
 
-  strcpy(fileNameBuffer, "/");
-  strcat(fileNameBuffer, variable);
+  LogFile *log = this->findLog(variable);
+
+  if (log != NULL)
+    this->flushLog(log);
 
   File dataFile = SD.open(fileNameBuffer, FILE_READ);
 
@@ -1085,12 +1720,13 @@ uint16_t AMController::sdFileSize(const char *variable) {
 
 void AMController::sdPurgeLogData(const char *variable) {
 
+  this->closeLog(variable);
+
   noInterrupts();
 
-  char fileNameBuffer[VARIABLELEN + 1];
+  char fileNameBuffer[VARIABLELEN + 2];
 
-  strcpy(fileNameBuffer, "/");
-  strcat(fileNameBuffer, variable);
+  snprintf(fileNameBuffer, sizeof(fileNameBuffer), "/%s", variable);
 
   SD.remove(fileNameBuffer);
 
@@ -1111,10 +1747,49 @@ void AMController::notifyDisconnected() {
 
   _connectionChanged = true;
   _connected = false;
+  _mtu = DEFAULT_MTU;
 }
 
 
-void AMController::dataAvailable(String data) {
-  strcat(_remainBuffer, data.c_str());
+/**
+	Store bytes received by onWrite, in the BLE task. When the buffer is full
+	the rest of the pair is dropped up to its #, then RX_RESYNC tells the
+	parser to drop the part it already has.
+**/
+void AMController::dataAvailable(const uint8_t *data, size_t length) {
+
+  for (size_t i = 0; i < length; i++) {
+
+    if (_rxDropping) {
+      if (data[i] == '#') {
+        _rxDropping = false;
+        _rxResync = true;
+      }
+      continue;
+    }
+
+    bool full = (uint16_t)(_rxHead - _rxTail) >= RX_BUFFER_SIZE - (_rxResync ? 1 : 0);
+
+    if (full) {
+      _droppedCommands++;
+      _rxDropping = data[i] != '#';
+      _rxResync = true;
+      continue;
+    }
+
+    if (_rxResync) {
+      _rxBuffer[_rxHead & (RX_BUFFER_SIZE - 1)] = RX_RESYNC;
+      _rxHead++;
+      _rxResync = false;
+    }
+
+    _rxBuffer[_rxHead & (RX_BUFFER_SIZE - 1)] = data[i];
+    _rxHead++;
+  }
+
   _dataAvailable = true;
 }
+
+unsigned long AMController::droppedCommands() {
+  return _droppedCommands;
+}
@@ -36,10 +36,35 @@
 #define SERVICE_UUID        "378ab488-2479-11e9-ab14-d663bd873d93"
 #define CHARACTERISTIC_UUID "56da9eca-2479-11e9-ab14-d663bd873d93"
 
-#define WRITE_DELAY	10					 // Delay after notification
+#define WRITE_TIMEOUT	100					 // [ms] Longest wait for a notification to be handed to the stack
+
+#define BLE_MTU                 247   // ATT MTU offered to the client, a notification carries MTU - 3 bytes
+#define DEFAULT_MTU             23    // ATT MTU until the client negotiates a larger one
+
+#define OUTBOUND_QUEUE_LENGTH   32    // Messages waiting to be notified
+#define OUTBOUND_MESSAGE_SIZE   128   // Longest message, longer buffers are queued in pieces
+#define WRITER_TASK_STACK       4096
+#define WRITER_TASK_PRIORITY    1
+#define WRITER_TASK_CORE        1
 
 #ifdef SD_SUPPORT
 #include <SD.h>
+
+#define STREAM_BLOCK_SIZE       4096  // Bytes read from SD at once when streaming a file
+#define STREAM_QUEUE_LENGTH     4     // Stream requests waiting
+#define STREAM_TASK_STACK       4096
+#define STREAM_TASK_PRIORITY    1
+#define STREAM_TASK_CORE        1
+
+#define STREAM_DOWNLOAD         0     // $SDDL$, raw file content between $C$ and $E$
+#define STREAM_LOG_DATA         1     // $SDLogData$, one message per line
+#define STREAM_LIST             2     // SD, one message per file then $EFL$
+#endif
+
+#ifdef SDLOGGEDATAGRAPH_SUPPORT
+#define LOG_FILES               4     // Log files kept open at once
+#define LOG_BUFFER_SIZE         512   // Bytes of samples buffered per log file
+#define LOG_FLUSH_INTERVAL      10000 // [ms] Longest a sample stays in RAM
 #endif
 
 #if defined(ALARMS_SUPPORT)
@@ -51,12 +76,52 @@
 
 #define MAX_ALARMS             5      // Maximum number of Alarms Widgets
 #define ALARM_CHECK_INTERVAL  60      // [s]
+#define ALARM_KEY_OFFSET      offsetof(Alarm, id)         // Alarm records are indexed on their id
+#define ALARM_KEY_LENGTH      sizeof(((Alarm *)0)->id)
 
 #endif
 
 #define VARIABLELEN       14
 #define VALUELEN          14
 
+#define RX_BUFFER_SIZE    256     // Incoming bytes waiting to be parsed, a power of two
+#define RX_RESYNC         0x18    // Put in the incoming bytes after an overflow, the pair being parsed is dropped
+
+#define COMMAND_NEEDS_VALUE   0x01  // Handler only called for a non empty value
+#define COMMAND_FORWARD       0x02  // Also passed to processIncomingMessages
+
+/*
+  Message waiting in the outbound queue
+*/
+typedef struct {
+  uint16_t  length;
+  uint8_t   data[OUTBOUND_MESSAGE_SIZE];
+} OutboundMessage;
+
+#ifdef SDLOGGEDATAGRAPH_SUPPORT
+/*
+  Open log file and the samples not written yet
+*/
+typedef struct {
+  char          variable[VARIABLELEN + 1];
+  File          file;
+  char          buffer[LOG_BUFFER_SIZE];
+  uint16_t      length;
+  unsigned long firstSample;    // millis() of the oldest buffered sample
+  unsigned long lastUsed;
+} LogFile;
+#endif
+
+#ifdef SD_SUPPORT
+/*
+  File to stream, handled by the stream task
+*/
+typedef struct {
+  uint8_t   type;
+  char      name[VALUELEN + 1];
+} StreamRequest;
+#endif
+
 class AMController {
 
   private:
@@ -70,15 +135,69 @@ class AMController {
 
     volatile bool 				_dataAvailable;
 
-    char      						_remainBuffer[128];
+    /*
+      Incoming bytes, written by the BLE task and parsed in loop()
+    */
+    uint8_t								_rxBuffer[RX_BUFFER_SIZE];
+    volatile uint16_t			_rxHead;
+    volatile uint16_t			_rxTail;
+    bool									_rxDropping;
+    bool									_rxResync;
+    unsigned long					_droppedCommands;
+
+    /*
+      Parser state, kept between calls so every byte is looked at once
+    */
+    enum { PARSE_VARIABLE, PARSE_VALUE, PARSE_SKIP } _parseState;
+    char									_variable[VARIABLELEN + 1];
+    char									_value[VALUELEN + 1];
+    uint8_t								_variableLength;
+    uint8_t								_valueLength;
+    uint32_t							_variableHash;
+
+    typedef struct {
+      uint32_t    hash;
+      const char  *name;
+      void        (AMController::*handler)(char *value);
+      uint8_t     flags;
+    } CommandEntry;
+
+    static const CommandEntry _commands[];
 
     volatile    bool 			_connectionChanged;
     volatile    bool      _connected;
     bool									_sync;
 
+    QueueHandle_t					_outQueue;
+    TaskHandle_t					_writerTask;
+    volatile bool					_congested;
+    volatile unsigned long	_droppedMessages;
+    portMUX_TYPE					_outLock;
+    TaskHandle_t					_outOwner;				// Only task queueing messages, NULL for any
+    int										_outSenders;			// Tasks queueing a message now
+    volatile uint16_t			_mtu;
+    unsigned long					_notifications;
+
+    static AMController		*_instance;
+
 #ifdef SD_SUPPORT
     File      						_root;
     File      						_entry;
+
+    QueueHandle_t					_streamQueue;
+    TaskHandle_t					_streamTask;
+    uint8_t								_streamBlock[STREAM_BLOCK_SIZE];
+    volatile bool					_streaming;
+    volatile unsigned long	_streamSize;
+    volatile unsigned long	_streamRead;
+    volatile unsigned long	_streamStart;
+    volatile unsigned long	_streamTime;
+#endif
+
+#ifdef SDLOGGEDATAGRAPH_SUPPORT
+    LogFile								_logFiles[LOG_FILES];
+    unsigned long					_logSamples;
+    unsigned long					_logWrites;
 #endif
 
 #ifdef ALARMS_SUPPORT
@@ -87,6 +206,9 @@ class AMController {
     unsigned long     		_lastAlarmCheck;
     char 									_alarmId[8];
     unsigned long    			_alarmTime;
+    Alarm									_alarms[MAX_ALARMS];	// Min-heap on the next fire time
+    uint8_t								_alarmCount;
+    bool									_alarmsLoaded;
 #endif
 
     /**
@@ -135,9 +257,59 @@ class AMController {
 
     void readVariable(void);
 
+    void resetParser(void);
+    void parseByte(uint8_t c);
+    void dispatchCommand(void);
+
+    void commandSync(char *value);
+#ifdef ALARMS_SUPPORT
+    void commandAlarmId(char *value);
+    void commandAlarmTime(char *value);
+    void commandAlarmRepeat(char *value);
+    void commandTime(char *value);
+#endif
+#ifdef SD_SUPPORT
+    void commandSdList(char *value);
+    void commandSdDownload(char *value);
+
+    bool requestStream(uint8_t type, const char *name);
+    void streamDownload(const char *name);
+    void streamList();
+    static void streamTask(void *pController);
+#endif
+#ifdef SDLOGGEDATAGRAPH_SUPPORT
+    void commandLogData(char *value);
+    void streamLogData(const char *variable);
+
+    void sdLogRow(const char *variable, unsigned long time, const float *values, int count);
+    LogFile *findLog(const char *variable);
+    LogFile *openLog(const char *variable);
+    void flushLog(LogFile *log);
+    void closeLog(const char *variable);
+    void flushExpiredLogs();
+#endif
+
+    bool enqueue(const uint8_t *buffer, int l, TickType_t wait, bool countDropped = true);
+    void claimOutbound();
+    void releaseOutbound();
+    void sendTxtMessage(const char *variable, const char *value, TickType_t wait);
+    void notifyPacket(const uint8_t *buffer, int l);
+    void sendQueued(OutboundMessage *message);
+
+    static void writerTask(void *pController);
+    static void gattsEvent(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
+
 #ifdef ALARMS_SUPPORT
 
     void inizializeAlarms();
+    void migrateAlarms();
+    static bool loadAlarm(uint8_t *pRecord, void *pData);
+    bool saveAlarm(Alarm &a);
+    bool eraseAlarm(Alarm &a);
+    int findAlarm(char *id);
+    void siftUpAlarm(int pos);
+    void siftDownAlarm(int pos);
+    void removeAlarmAt(int pos);
     void checkAndFireAlarms();
     void createUpdateAlarm(char *id, unsigned long time, bool repeat);
     void removeAlarm(char *id);
@@ -175,6 +347,7 @@ class AMController {
     void writeMessage(const char *variable, float value);
     void writeTripleMessage(const char *variable, float vX, float vY, float vZ);
     void writeTxtMessage(const char *variable, const char *value);
+    bool tryWriteTxtMessage(const char *variable, const char *value); // false when not queued, retry later
     
     void setDeviceName(const char *deviceName);
     
@@ -191,6 +364,16 @@ class AMController {
     
     void temporaryDigitalWrite(uint8_t pin, uint8_t value, unsigned long ms);
 
+    unsigned long droppedMessages();    // Messages lost because the outbound queue was full or held by a download
+    unsigned long notificationsSent();
+    unsigned long droppedCommands();    // Incoming buffer overflows and pairs too long to parse
+#ifdef SD_SUPPORT
+    bool streaming();                   // A file is being sent
+    unsigned long streamSize();         // Size of the file being sent or last sent
+    unsigned long streamProgress();     // Bytes of it read so far
+    unsigned long streamRate();         // Bytes per second
+#endif
+
 #ifdef ALARMS_SUPPORT
     unsigned long now();
 #ifdef DEBUG
@@ -218,13 +401,18 @@ class AMController {
 
     uint16_t sdFileSize(const char *variable);
     void sdPurgeLogData(const char *variable);
+
+    void sdFlushLog();                  // Write all buffered samples, e.g. before power off
+    unsigned long sdLogSamples();       // Samples logged since start
+    unsigned long sdLogWrites();        // Writes to SD for them
 #endif
 
     void writeBuffer(uint8_t *buffer, int l);
+    bool tryWriteBuffer(const uint8_t *buffer, int l); // false when there is no room now, retry later
     void processIncomingData(void);
     void notifyConnected(void);
     void notifyDisconnected(void);
-    void dataAvailable(String);
+    void dataAvailable(const uint8_t *data, size_t length);
 
     /**
     	This class manages connection and disconnection
@@ -277,22 +465,7 @@ class AMController {
 
         void onWrite(BLECharacteristic *pCharacteristic) {
 
-          //String rxValue = pCharacteristic->getValue();
-          String rxValue = String(pCharacteristic->getValue().c_str());
-
-          /*
-                if (rxValue.length() > 0) {
-
-                  Serial.println("*********");
-                  Serial.print("Received Value: ");
-                  for (int i = 0; i < rxValue.length(); i++)
-                    Serial.print(rxValue[i]);
-
-                  Serial.println();
-                  Serial.println("*********");
-                }
-          */
-          pController->dataAvailable(rxValue);
+          pController->dataAvailable(pCharacteristic->getData(), pCharacteristic->getLength());
         }
     };
 
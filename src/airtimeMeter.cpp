@@ -0,0 +1,56 @@
+#include "airtimeMeter.h"
+#include <string.h>
+
+// Constructor
+AirtimeMeter::AirtimeMeter(uint32_t window)
+    : window(window),
+      bucketLength(window / AIRTIME_BUCKETS),
+      bucketStart(0),
+      current(0) {
+    memset(buckets, 0, sizeof(buckets));
+}
+
+// Clear the buckets that left the window
+void AirtimeMeter::advance(unsigned long now) {
+    unsigned long elapsed = now - bucketStart;
+    if (elapsed < bucketLength) {
+        return;
+    }
+
+    unsigned long steps = elapsed / bucketLength;
+    if (steps > AIRTIME_BUCKETS) {
+        steps = AIRTIME_BUCKETS;
+    }
+    for (unsigned long i = 0; i < steps; i++) {
+        current = (current + 1) % AIRTIME_BUCKETS;
+        buckets[current] = 0;
+    }
+    bucketStart = now - elapsed % bucketLength;
+}
+
+// Account a transmission of airtime us ending at now
+void AirtimeMeter::add(uint32_t airtime, unsigned long now) {
+    advance(now);
+    buckets[current] += airtime;
+}
+
+// Time on air in the window in us
+uint32_t AirtimeMeter::used(unsigned long now) {
+    advance(now);
+
+    uint32_t total = 0;
+    for (int i = 0; i < AIRTIME_BUCKETS; i++) {
+        total += buckets[i];
+    }
+    return total;
+}
+
+// Share of the window on air in ppm
+uint32_t AirtimeMeter::utilization(unsigned long now) {
+    return (uint32_t) ((uint64_t) used(now) * 1000 / window);
+}
+
+// Resolution of the window in ms
+uint32_t AirtimeMeter::getBucketLength() const {
+    return bucketLength;
+}
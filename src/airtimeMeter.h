@@ -0,0 +1,32 @@
+// airtimeMeter.h
+#ifndef AIRTIME_METER_H
+#define AIRTIME_METER_H
+
+#include <stdint.h>
+
+#define AIRTIME_BUCKETS 12
+
+// Time the transmitter was keyed over a sliding window
+//
+// The window is split in AIRTIME_BUCKETS buckets, expired buckets are
+// cleared as time moves on, so the window slides in steps of one bucket.
+class AirtimeMeter {
+private:
+    uint32_t buckets[AIRTIME_BUCKETS]; // Time on air per bucket in us
+    uint32_t window;                   // Window length in ms
+    uint32_t bucketLength;             // Bucket length in ms
+    unsigned long bucketStart;         // Start of the current bucket
+    int current;                       // Index of the current bucket
+
+    void advance(unsigned long now);
+
+public:
+    AirtimeMeter(uint32_t window);
+
+    void add(uint32_t airtime, unsigned long now);
+    uint32_t used(unsigned long now);
+    uint32_t utilization(unsigned long now);
+    uint32_t getBucketLength() const;
+};
+
+#endif // AIRTIME_METER_H
@@ -4,7 +4,13 @@
 
 #include <AM_ESP32Ble.h>
 
-#include "schraderQueue.h"
+#include "airtimeMeter.h"
+#include "radioModes.h"
+#include "relayQueue.h"
+#include "relayStore.h"
+#include "relay_protocols.h"
+#include "sensorActivity.h"
+#include "tireHistory.h"
 
 /******* Start Global Variable for Widgets *******/
 char deviceName[VALUELEN + 1] = "TPMS_RELAY";
@@ -18,12 +24,66 @@ char deviceName[VALUELEN + 1] = "TPMS_RELAY";
 #endif
 
 #define JSON_MSG_BUFFER 512
-#define RAW_BUFFER_SIZE 15
+#define RAW_BUFFER_SIZE 16
+
+#define EVENT_BUFFER_SIZE 128
+#define EVENT_FRAME_SYNC 0xA5
 
 #define RETRANSMISSION_DELAY 30000
 #define RETRANSMISSION_COUNT 2 * 30 // 2 transmissions per minute for 30 minutes
 
-#define RADIO_MODE_DELAY 100
+#ifndef RELAY_STRONG_RSSI
+#  define RELAY_STRONG_RSSI -60 // dBm, sensors heard this well directly are relayed less often
+#endif
+#define RELAY_BACKOFF 4         // Interval multiplier for sensors heard this well
+#ifndef RELAY_PRESSURE_DROP
+#  define RELAY_PRESSURE_DROP 20 // kPa, readings dropping this much are relayed more often
+#endif
+#define RELAY_SPEEDUP 3         // Interval divider for such readings
+#ifndef RELAY_AIRTIME_BUDGET
+#  define RELAY_AIRTIME_BUDGET 10000 // ppm, share of airtime the relay schedule may plan for
+#endif
+
+#ifndef RELAY_DUTY_CYCLE
+#  define RELAY_DUTY_CYCLE 100000 // ppm, measured airtime cap over AIRTIME_WINDOW (ETSI EN 300 220, 433 MHz: 10 %)
+#endif
+#ifndef AIRTIME_WINDOW
+#  define AIRTIME_WINDOW 60000 // ms, sliding window of the duty cycle
+#endif
+#define DUTY_CYCLE_RESERVE 4    // Last 1/4 of the cap is kept for changed readings
+
+#ifndef RELAY_QUEUE_SIZE
+#  define RELAY_QUEUE_SIZE 64 // Sensors relayed at the same time
+#endif
+#define DASHBOARD_SLOTS 12   // tire1 .. tire12 widgets in Arduino Manager
+#define DASHBOARD_TEXT_SIZE 48
+#ifndef RELAY_CHECKPOINT_INTERVAL
+#  define RELAY_CHECKPOINT_INTERVAL 300000 // ms between checkpoints of the relay queue to NVS, 0 disables
+#endif
+#ifndef RELAY_MAX_AGE
+#  define RELAY_MAX_AGE (RETRANSMISSION_DELAY / 1000 * RETRANSMISSION_COUNT) // s, older readings are not restored
+#endif
+
+#ifndef HISTORY_RANGE
+#  define HISTORY_RANGE (30UL * 24 * 3600) // s of history sent for a history request
+#endif
+#define HISTORY_POINTS 60    // Points sent for a history request
+// SD_CS_PIN: chip select of an SD card, enables the tire history
+
+#ifndef TX_WINDOW_HORIZON
+#  define TX_WINDOW_HORIZON 2000 // Entries due this soon go out in the same TX window
+#endif
+#ifndef TX_QUIET_GAP
+#  define TX_QUIET_GAP 300       // Channel quiet time required before a TX window
+#endif
+#ifndef TX_MAX_DEFER
+#  define TX_MAX_DEFER 5000      // Longest a TX window waits for a quiet channel
+#endif
+
+#ifndef RECEIVER_SILENCE_FACTOR
+#  define RECEIVER_SILENCE_FACTOR 4 // Sensor transmissions missed without a reception before the receiver is reported deaf
+#endif
+#define SILENCE_CHECK_INTERVAL 1000 // ms between checks for silent sensors
 
 #define RADIOLIB_STATE(STATEVAR, FUNCTION)                            \
 {                                                                     \
@@ -44,12 +104,39 @@ void deviceConnected();
 
 AMController amController(&doWork, &doSync, &processIncomingMessages, &processOutgoingMessages, &processAlarms, &deviceConnected, NULL);
 
+// Protocols relayed, received payloads are matched in this order
+typedef RelayProtocols<SchraderEG53MA4> Relayed;
+
+static_assert(Relayed::maxPayloadSize <= RAW_BUFFER_SIZE, "RAW_BUFFER_SIZE too small");
+static_assert(Relayed::maxFrameSize <= RELAY_FRAME_SIZE, "RELAY_FRAME_SIZE too small");
+static_assert(DASHBOARD_SLOTS <= 32, "dashboardDirty has a bit per slot");
+
 uint8_t receiveDataBuffer[RAW_BUFFER_SIZE];
-uint8_t transmitDataBuffer[RAW_BUFFER_SIZE];
-SchraderQueue schraderQueue(RETRANSMISSION_COUNT, RETRANSMISSION_DELAY);
+uint8_t transmitDataBuffer[RELAY_FRAME_SIZE];
+RelayQueue relayQueue(RELAY_QUEUE_SIZE, RETRANSMISSION_COUNT, RELAY_AIRTIME_BUDGET);
+RelayStore relayStore(RELAY_CHECKPOINT_INTERVAL, RELAY_MAX_AGE);
+AirtimeMeter airtimeMeter(AIRTIME_WINDOW);
+TireHistory tireHistory;
+
+// History reply being sent, continued on every loop() pass while the outbound queue has room
+HistoryPoint historyPoints[HISTORY_POINTS];
+int historyProtocol = 0;
+int historyCount = -1;  // Points of the reply, -1 when none is being sent
+int historySent = 0;    // Messages queued, the points then the closing history=#
 
 char messageBuffer[JSON_MSG_BUFFER];
 
+// Dashboard as last sent to Arduino Manager, only slots that changed are sent again
+char dashboardText[DASHBOARD_SLOTS][DASHBOARD_TEXT_SIZE];
+uint32_t dashboardDirty = 0;
+int dashboardQueueSize = -1;
+uint32_t dashboardAirtime = 0;
+uint32_t dashboardDutyCycle = 0;
+
+#ifdef BINARY_EVENTS
+uint8_t eventBuffer[EVENT_BUFFER_SIZE];
+#endif
+
 int lastRetransmission = millis();
 int lastTransmission = millis();
 int lastReceived = millis();
@@ -58,15 +145,38 @@ volatile bool transmitting = false;
 volatile bool dataChanged = false;
 volatile int transmitCount = 0;
 
+bool txWindowOpen = false;
+unsigned long txWindowStart = 0;
+bool txWaiting = false;
+bool txDeferred = false;
+unsigned long txDueSince = 0;
+int txDeferrals = 0;
+unsigned long firstRelay = 0;
+int txThrottled = 0;
+
+volatile unsigned long txStartMicros = 0;
+volatile unsigned long txEndMicros = 0;
+bool txMeasured = true;
+
 rtl_433_ESP rf;
+RadioModes radioModes(rtl_433_ESP::getRadio());
+
+#ifdef DEAF_WATCHDOG
+SensorActivity sensorActivity(RECEIVER_SILENCE_FACTOR);
+unsigned long lastSilenceCheck = 0;
+int receiverReconfigures = 0;
+#endif
 
 void setupRx();
 void setupTx();
+void historyLoop();
+void sendDashboardSlots();
 
 void transmitHandler() {
   int state = rf.getRadio().finishTransmit();
   RADIOLIB_STATE(state, "finishTransmit");
   
+  txEndMicros = micros();
   transmitting = false;
   lastRetransmission = millis();
 }
@@ -74,14 +184,21 @@ void transmitHandler() {
 void relay(uint8_t* data, int dataSize) {  
   transmitting = true;
   
+  #if LOG_LEVEL >= LOG_LEVEL_VERBOSE
   Log.verbose(F("Sending data (%d bytes): " CR), dataSize);
   for (int i = 0; i < dataSize; i++) {
     Log.verbose("%X ", data[i]);
   }
   Log.verbose(F(CR));
+  #endif
   
+  txMeasured = false;
+  txStartMicros = micros();
   int state = rf.getRadio().startTransmit(data, dataSize);
   RADIOLIB_STATE(state, "startTransmit");
+
+  // startTransmit() remaps GDO2
+  radioModes.invalidate();
 }
 
 void logJson(JsonObject& jsondata) {
@@ -95,6 +212,27 @@ void logJson(JsonObject& jsondata) {
   Log.notice(F("Received message : %s" CR), JSONmessageBuffer);
 }
 
+// RSSI of a received message, from the "rssi" field of its JSON
+int messageRssi(const char* message) {
+  const char* rssi = strstr(message, "\"rssi\":");
+  return rssi ? atoi(rssi + 7) : -128;
+}
+
+// Time on air in us of a frame, the CC1101 sends two Manchester chips per bit
+uint16_t frameAirtime(int frameSize) {
+  return (uint16_t) (frameSize * 8 * 2 * 1000 / BIT_RATE);
+}
+
+// Retransmission interval of a reading, relayed more often when the pressure
+// dropped and less often when the sensor is heard well without the relay
+time_t relayInterval(int rssi, int pressureDrop) {
+  if (pressureDrop >= RELAY_PRESSURE_DROP)
+    return RETRANSMISSION_DELAY / RELAY_SPEEDUP;
+  if (rssi >= RELAY_STRONG_RSSI)
+    return RETRANSMISSION_DELAY * RELAY_BACKOFF;
+  return RETRANSMISSION_DELAY;
+}
+
 void rtl_433_Callback(char* message, uint8_t* data, int dataSize) {
   #if LOG_LEVEL >= LOG_LEVEL_NOTICE
   DynamicJsonBuffer jsonBuffer2(JSON_MSG_BUFFER);
@@ -103,14 +241,71 @@ void rtl_433_Callback(char* message, uint8_t* data, int dataSize) {
   #endif
 
   Log.notice(F("Received data (%d bytes): " CR), dataSize);
-  
-  schraderQueue.addOrUpdateEntry(data);
+
+  if (data == NULL) {
+    return;
+  }
+
+  int protocol = Relayed::match(data, dataSize);
+  if (protocol < 0) {
+    return;
+  }
+
+  // The frame is built once per reading and sent as is on every retransmission
+  RelayEntry reading;
+  reading.frameSize = Relayed::encode(protocol, data, reading.frame);
+  reading.protocol = protocol;
+  reading.id = Relayed::id(protocol, data);
+#ifdef DEAF_WATCHDOG
+  sensorActivity.heard(protocol, reading.id, millis());
+#endif
+  reading.pressure = Relayed::pressure(protocol, data);
+  reading.airtime = frameAirtime(reading.frameSize);
+
+  RelayEntry previous;
+  bool known = relayQueue.findEntry(protocol, reading.id, previous);
+  int pressureDrop = known ? previous.pressure - reading.pressure : 0;
+  reading.changed = known && previous.pressure != reading.pressure;
+  reading.interval = relayInterval(messageRssi(message), pressureDrop);
+
+  // History needs the time from Arduino Manager
+  HistoryPoint point;
+  point.time = amController.now();
+  if (point.time != 0) {
+    point.pressureRaw = Relayed::pressureRaw(protocol, data);
+    point.temperatureRaw = Relayed::temperatureRaw(protocol, data);
+    tireHistory.record(protocol, reading.id, point);
+  }
+
+  if (!relayQueue.addOrUpdateEntry(reading, (time_t) millis())) {
+    Log.warning(F("Relay queue full, %d entries" CR), relayQueue.getCapacity());
+  }
 }
 
+#ifdef BINARY_EVENTS
+// Frame: sync byte, payload length, CBOR payload, sum of payload bytes modulo 256
+// Decode on the host with lib/rtl_433_ESP/tools/event_decoder.py
+void rtl_433_EventCallback(uint8_t* event, int eventSize) {
+  uint8_t header[2] = {EVENT_FRAME_SYNC, (uint8_t) eventSize};
+  uint8_t checksum = 0;
+
+  for (int i = 0; i < eventSize; i++) {
+    checksum += event[i];
+  }
+
+  Serial.write(header, sizeof(header));
+  Serial.write(event, eventSize);
+  Serial.write(checksum);
+}
+#endif
+
+// TX configuration through RadioLib, run once to capture the TX profile
 void setupTx() {
-  CC1101 radio = rf.getRadio();
+  CC1101& radio = rf.getRadio();
   int state;
 
+  radio.packetMode();
+
   state = radio.setOOK(true);
   RADIOLIB_STATE(state, "setOOK");
   
@@ -122,13 +317,29 @@ void setupTx() {
   
   state = radio.setBitRate(BIT_RATE);
   RADIOLIB_STATE(state, "setBitRate");
-  
-  radio.setGdo2Action(transmitHandler, FALLING);
 }
 
 void setupRx() {
   rf.initReceiver(RF_MODULE_RECEIVER_GPIO, RF_MODULE_FREQUENCY);
   rf.setCallback(rtl_433_Callback, messageBuffer, JSON_MSG_BUFFER, receiveDataBuffer, RAW_BUFFER_SIZE);
+#ifdef BINARY_EVENTS
+  rf.setEventCallback(rtl_433_EventCallback, eventBuffer, EVENT_BUFFER_SIZE);
+#endif
+  rf.enableReceiver();
+}
+
+// Capture the RX configuration left by setupRx() and the TX one of
+// setupTx(), mode switches then only write the registers that differ
+void setupProfiles() {
+  radioModes.capture(RADIO_RX);
+
+  rf.disableReceiver();
+  setupTx();
+  radioModes.capture(RADIO_TX);
+
+  if (!radioModes.apply(RADIO_RX)) {
+    Log.warning(F("Radio not in RX after capturing the profiles" CR));
+  }
   rf.enableReceiver();
 }
 
@@ -146,75 +357,222 @@ void setup() {
     
   int state = rf.getRadio().begin();
   RADIOLIB_STATE(state, "begin");
-  
+
+  // Resume relaying the sensors known before the restart
+  if (!relayStore.begin(RELAY_QUEUE_SIZE)) {
+    Log.warning(F("Relay store not opened, relay queue not checkpointed" CR));
+  }
+  int restored = relayStore.restore(relayQueue, Relayed::count, (time_t) millis());
+  Log.notice(F("Restored %d relay entries" CR), restored);
+
   setupRx();
+  setupProfiles();
+
+#ifdef SD_CS_PIN
+  if (SD.begin(SD_CS_PIN)) {
+    tireHistory.begin();
+  } else {
+    Log.warning(F("SD card not mounted, no tire history" CR));
+  }
+#endif
 
   amController.begin(deviceName);  
   Log.notice(F("****** setup complete ******" CR));
 }
 
 void setModeTx() {
-  // Stop the receiver
+  // Stop the receiver, waits for the receiver task to leave the radio alone
   rf.disableReceiver();
-  rf.getRadio().packetMode();
-  delay(RADIO_MODE_DELAY);
 
-  // Enable the transmitter  
-  setupTx();
-  delay(RADIO_MODE_DELAY);
+#ifdef DEAF_WATCHDOG
+  // The receiver watchdog reset the chip behind the shadow
+  if (rf.receiverResets[DEAF_RESET_RECONFIGURE] != receiverReconfigures) {
+    receiverReconfigures = rf.receiverResets[DEAF_RESET_RECONFIGURE];
+    radioModes.invalidate();
+  }
+#endif
+
+#ifdef CARRIER_SENSE_GPIO
+  // The receiver moves the carrier sense threshold while it runs
+  radioModes.capture(RADIO_RX);
+#endif
+
+  // Enable the transmitter, through RadioLib if the chip did not go idle
+  if (!radioModes.apply(RADIO_TX)) {
+    Log.warning(F("Radio not idle for TX, reconfiguring" CR));
+    setupTx();
+    radioModes.invalidate();
+  }
+  rf.getRadio().setGdo2Action(transmitHandler, FALLING);
 }
 
 void setModeRx() {
   // Disable the transmitter
   rf.getRadio().clearGdo2Action();
-  delay(RADIO_MODE_DELAY);
 
-  // Reinitialize the receiver
-  rf.setRXSettings();
-  rf.getRadio().receiveDirectAsync();
+  // Restart the receiver, through RadioLib if the chip did not enter RX
+  if (!radioModes.apply(RADIO_RX)) {
+    Log.warning(F("Radio not in RX, reinitializing receiver" CR));
+    rf.setRXSettings();
+    rf.getRadio().receiveDirectAsync();
+    radioModes.invalidate();
+  }
   rf.enableReceiver();
-  delay(RADIO_MODE_DELAY);
 }
 
+// Entries are sent in windows: once the first entry is due the radio is
+// switched to TX, every entry due within TX_WINDOW_HORIZON is sent back to
+// back and the radio is switched back to RX, so the receiver is deaf once
+// per window rather than once per packet.
+//
+// A window only opens once the channel has been quiet for TX_QUIET_GAP, so
+// a signal being received is not cut off, waiting at most TX_MAX_DEFER.
+//
+// The time on air measured from startTransmit() to the end of packet
+// interrupt is kept under RELAY_DUTY_CYCLE over AIRTIME_WINDOW. Close to the
+// cap unchanged readings are postponed so changed ones go first; at the cap
+// no window opens until older airtime leaves the window.
 void transmitLoop() {
-  // Check if we should transmit
-  if (schraderQueue.getNextEntryToRetransmit(transmitDataBuffer, (time_t) millis())) {
-    // If first packet
-    if (transmitCount == 0)
-      setModeTx();
-
-    // Transmit the data
-    relay(transmitDataBuffer, RAW_BUFFER_SIZE);
-    
+  // Wait for the current packet to finish
+  if (transmitting)
+    return;
+
+  if (!txMeasured) {
+    txMeasured = true;
+    airtimeMeter.add(txEndMicros - txStartMicros, millis());
+  }
+
+  uint32_t utilization = airtimeMeter.utilization(millis());
+
+  if (!txWindowOpen) {
+    if (utilization >= RELAY_DUTY_CYCLE) {
+      if (relayQueue.isEntryDue((time_t) millis()) && !txWaiting) {
+        txWaiting = true;
+        txDeferred = false;
+        txDueSince = millis();
+        txThrottled++;
+      }
+      return;
+    }
+
+    if (utilization >= RELAY_DUTY_CYCLE - RELAY_DUTY_CYCLE / DUTY_CYCLE_RESERVE) {
+      relayQueue.deferUnchangedEntries((time_t) (millis() + TX_WINDOW_HORIZON), airtimeMeter.getBucketLength());
+    }
+
+    if (!relayQueue.isEntryDue((time_t) millis())) {
+      txWaiting = false;
+      return;
+    }
+
+    if (!txWaiting) {
+      txWaiting = true;
+      txDeferred = false;
+      txDueSince = millis();
+    }
+
+    // Listen before relaying
+    if (rf.channelQuietTime() < TX_QUIET_GAP && millis() - txDueSince < TX_MAX_DEFER) {
+      if (!txDeferred) {
+        txDeferred = true;
+        txDeferrals++;
+      }
+      return;
+    }
+
+    txWaiting = false;
+    txWindowStart = millis();
+    txWindowOpen = true;
+    setModeTx();
+  }
+
+  // Transmit the next packet of the window, the rest waits if the cap is reached
+  int frameSize = 0;
+  if (utilization < RELAY_DUTY_CYCLE) {
+    frameSize = relayQueue.getNextEntryToRetransmit(transmitDataBuffer, (time_t) (txWindowStart + TX_WINDOW_HORIZON));
+  }
+  if (frameSize > 0) {
+    relay(transmitDataBuffer, frameSize);
+
+    if (firstRelay == 0) {
+      firstRelay = millis();
+      Log.notice(F("First relay %l ms after boot" CR), firstRelay);
+    }
+
     transmitCount++;
     dataChanged = true;
+    return;
   }
-  // Check if we have transmitted all packets
-  else {
-    if (transmitCount > 0) {
-      transmitCount = 0;
-      Log.notice(F("All packets transmitted. Reinitalizing receiver." CR));
-            
-      setModeRx();
-      dataChanged = true;
+
+  // All packets of the window transmitted
+  setModeRx();
+  Log.notice(F("TX window: %d packets sent, receiver deaf for %l ms, deferred %l ms, %d windows deferred, %d receptions aborted" CR),
+             transmitCount, millis() - txWindowStart, txWindowStart - txDueSince, txDeferrals, rf.abortedSignals);
+  Log.notice(F("Mode switch: to TX %l us (avg %l, max %l), to RX %l us (avg %l, max %l), %l registers written, %l timeouts" CR),
+             radioModes.getLastSwitch(RADIO_TX), radioModes.getAverageSwitch(RADIO_TX), radioModes.getMaxSwitch(RADIO_TX),
+             radioModes.getLastSwitch(RADIO_RX), radioModes.getAverageSwitch(RADIO_RX), radioModes.getMaxSwitch(RADIO_RX),
+             radioModes.getRegistersWritten(RADIO_TX) + radioModes.getRegistersWritten(RADIO_RX), radioModes.getTimeouts());
+  Log.notice(F("Relay airtime: %l ms total, planned load %l ppm of %l ppm budget, duty cycle %l ppm of %l ppm, %d windows throttled" CR),
+             relayQueue.getTotalAirtime(), relayQueue.getPlannedLoad(), (uint32_t) RELAY_AIRTIME_BUDGET,
+             utilization, (uint32_t) RELAY_DUTY_CYCLE, txThrottled);
+
+  txWindowOpen = false;
+  transmitCount = 0;
+  dataChanged = true;
+}
+
+// Render the tire slots, marking the ones whose text changed
+void renderDashboard() {
+  for (int i = 0; i < DASHBOARD_SLOTS; i++) {
+    char text[DASHBOARD_TEXT_SIZE];
+
+    if (!relayQueue.formatEntry(i, text, sizeof(text))) {
+      strcpy(text, "N/A");
+    }
+    if (strcmp(text, dashboardText[i]) != 0) {
+      strcpy(dashboardText[i], text);
+      dashboardDirty |= 1UL << i;
     }
   }
 }
 
-void sendDataToManager() {
-  // Send data to Arduino Manager
-  amController.writeMessage("queueSize", schraderQueue.getQueueSize());
+// Send the dashboard to Arduino Manager, only what changed unless fullSync
+void sendDataToManager(bool fullSync) {
+  renderDashboard();
 
-  // Iterate through the queue and send the data
-  for (int i = 0; i < schraderQueue.getQueueSize(); i++) {
-    std::string identifier = "tire" + std::to_string(i + 1);
-    amController.writeTxtMessage(identifier.c_str(), schraderQueue.formatEntry(i).c_str());
+  int queueSize = relayQueue.getQueueSize();
+  uint32_t airtime = relayQueue.getTotalAirtime();
+  uint32_t dutyCycle = airtimeMeter.utilization(millis()) / 100;
+
+  if (fullSync || queueSize != dashboardQueueSize) {
+    amController.writeMessage("queueSize", queueSize);
+    dashboardQueueSize = queueSize;
+  }
+  if (fullSync || airtime != dashboardAirtime) {
+    amController.writeMessage("airtime", (int) airtime);
+    dashboardAirtime = airtime;
+  }
+  if (fullSync || dutyCycle != dashboardDutyCycle) {
+    amController.writeMessage("dutyCycle", dutyCycle / 100.0f);
+    dashboardDutyCycle = dutyCycle;
+  }
+
+  if (fullSync) {
+    dashboardDirty = ~0UL;
   }
+  sendDashboardSlots();
+}
 
-  // Clear out any old data
-  for (int i = schraderQueue.getQueueSize(); i < 12; i++) {
-    std::string identifier = "tire" + std::to_string(i + 1);
-    amController.writeTxtMessage(identifier.c_str(), "N/A");
+// Send the slots marked as changed, a slot the outbound queue had no room
+// for stays marked and is sent again on a later loop() pass
+void sendDashboardSlots() {
+  for (int i = 0; i < DASHBOARD_SLOTS; i++) {
+    if (dashboardDirty & (1UL << i)) {
+      char identifier[12];
+      snprintf(identifier, sizeof(identifier), "tire%d", i + 1);
+      if (amController.tryWriteTxtMessage(identifier, dashboardText[i])) {
+        dashboardDirty &= ~(1UL << i);
+      }
+    }
   }
 }
 
@@ -223,9 +581,31 @@ void loop() {
   rf.loop();
   amController.loop();
 
+  // Flash writes stall both cores, keep them out of TX windows
+  if (!txWindowOpen) {
+    relayStore.checkpoint(relayQueue, (time_t) millis());
+  }
+
+  tireHistory.loop();
+  historyLoop();
+
+#ifdef DEAF_WATCHDOG
+  // Sensors that stopped being heard together point at a deaf receiver
+  if (millis() - lastSilenceCheck >= SILENCE_CHECK_INTERVAL) {
+    lastSilenceCheck = millis();
+    if (sensorActivity.checkSilence(millis())) {
+      Log.notice(F("No sensor heard for %l ms, %l silences reported" CR),
+                 sensorActivity.getSilence(millis()), sensorActivity.getSilences());
+      rf.reportSilence();
+    }
+  }
+#endif
+
   if (dataChanged) {
-    sendDataToManager();
+    sendDataToManager(false);
     dataChanged = false;
+  } else if (dashboardDirty) {
+    sendDashboardSlots();
   }
 
   delay(1);
@@ -237,11 +617,52 @@ void doWork() {
 void doSync() {
   Log.notice(F("Synchronizing" CR));
 
-  sendDataToManager();
+  sendDataToManager(true);
+}
+
+// Start sending the history of a sensor as history=time;kPa;C;-;-;-# lines,
+// like logged data, ending with an empty value. value is protocol:id in hex,
+// or the id of a sensor of the first protocol. A new request replaces the
+// reply being sent
+void sendHistory(const char* value) {
+  const char* separator = strchr(value, ':');
+  int protocol = separator ? atoi(value) : 0;
+  uint32_t id = strtoul(separator ? separator + 1 : value, NULL, 16);
+  uint32_t now = amController.now();
+
+  historyProtocol = protocol;
+  historyCount = now > HISTORY_RANGE ? tireHistory.query(protocol, id, now - HISTORY_RANGE, now, historyPoints, HISTORY_POINTS) : 0;
+  historySent = 0;
+  historyLoop();
+}
+
+// Queue as much of the history reply as the outbound queue takes now, the
+// rest on later passes rather than blocking loop() or dropping points
+void historyLoop() {
+  while (historyCount >= 0) {
+    char message[64];
+    if (historySent < historyCount) {
+      const HistoryPoint& point = historyPoints[historySent];
+      snprintf(message, sizeof(message), "history=%lu;%.1f;%.1f;-;-;-#", (unsigned long) point.time,
+               Relayed::pressureKpa(historyProtocol, point.pressureRaw), Relayed::temperatureC(historyProtocol, point.temperatureRaw));
+    } else {
+      strcpy(message, "history=#");
+    }
+    if (!amController.tryWriteBuffer((uint8_t*) message, strlen(message))) {
+      return;
+    }
+    if (historySent++ == historyCount) {
+      historyCount = -1;
+    }
+  }
 }
 
 void processIncomingMessages(char *variable, char *value) {
   Log.notice(F("Process Incoming" CR));
+
+  if (strcmp(variable, "history") == 0) {
+    sendHistory(value);
+  }
 }
 
 void processOutgoingMessages() {
@@ -0,0 +1,141 @@
+#include "radioModes.h"
+#include <string.h>
+
+// Constructor
+RadioModes::RadioModes(CC1101& radio)
+    : radio(radio),
+      shadowValid(false),
+      timeouts(0) {
+    memset(profiles, 0, sizeof(profiles));
+    memset(&shadow, 0, sizeof(shadow));
+    memset(switches, 0, sizeof(switches));
+    memset(lastSwitch, 0, sizeof(lastSwitch));
+    memset(maxSwitch, 0, sizeof(maxSwitch));
+    memset(totalSwitch, 0, sizeof(totalSwitch));
+    memset(registersWritten, 0, sizeof(registersWritten));
+}
+
+// Read the registers of a profile from the chip, two bursts
+void RadioModes::read(Profile& profile) {
+    radio.SPIreadRegisterBurst(RADIOLIB_CC1101_REG_IOCFG2, RADIO_PROFILE_REGISTERS, profile.registers);
+    radio.SPIreadRegisterBurst(RADIOLIB_CC1101_REG_PATABLE, RADIO_PATABLE_SIZE, profile.patable);
+}
+
+// Store the current configuration of the chip as the profile of a mode
+void RadioModes::capture(int mode) {
+    read(profiles[mode]);
+    shadow = profiles[mode];
+    shadowValid = true;
+}
+
+// Registers were written without going through the shadow
+void RadioModes::invalidate() {
+    shadowValid = false;
+}
+
+// Write the registers of a profile that differ from the shadow, runs of
+// changes closer than RADIO_BURST_GAP are merged into one burst
+void RadioModes::write(int mode) {
+    const Profile& profile = profiles[mode];
+    int reg = 0;
+
+    while (reg < RADIO_PROFILE_REGISTERS) {
+        if (profile.registers[reg] == shadow.registers[reg]) {
+            reg++;
+            continue;
+        }
+
+        int start = reg;
+        int end = reg + 1;
+        for (int next = end; next < RADIO_PROFILE_REGISTERS && next <= end + RADIO_BURST_GAP; next++) {
+            if (profile.registers[next] != shadow.registers[next]) {
+                end = next + 1;
+            }
+        }
+
+        radio.SPIwriteRegisterBurst(start, (uint8_t*) profile.registers + start, end - start);
+        registersWritten[mode] += end - start;
+        reg = end;
+    }
+
+    if (memcmp(profile.patable, shadow.patable, RADIO_PATABLE_SIZE) != 0) {
+        radio.SPIwriteRegisterBurst(RADIOLIB_CC1101_REG_PATABLE, (uint8_t*) profile.patable, RADIO_PATABLE_SIZE);
+        registersWritten[mode] += RADIO_PATABLE_SIZE;
+    }
+
+    shadow = profile;
+}
+
+// Poll MARCSTATE until the chip is in a state, false after RADIO_STATE_TIMEOUT
+bool RadioModes::waitState(uint8_t state) {
+    unsigned long start = micros();
+
+    while ((radio.SPIreadRegister(RADIOLIB_CC1101_REG_MARCSTATE) & RADIO_MARCSTATE_MASK) != state) {
+        if (micros() - start > RADIO_STATE_TIMEOUT) {
+            timeouts++;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Switch to a mode: idle, write the changed registers and, for RX, start
+// receiving. TX is left idle for startTransmit(). False if the chip did not
+// reach the state, the shadow is then read back on the next switch
+bool RadioModes::apply(int mode) {
+    unsigned long start = micros();
+
+    radio.SPIsendCommand(RADIOLIB_CC1101_CMD_IDLE);
+    bool ready = waitState(RADIO_MARCSTATE_IDLE);
+
+    if (ready) {
+        if (!shadowValid) {
+            read(shadow);
+            shadowValid = true;
+        }
+        write(mode);
+
+        if (mode == RADIO_RX) {
+            radio.SPIsendCommand(RADIOLIB_CC1101_CMD_RX);
+            ready = waitState(RADIO_MARCSTATE_RX);
+        }
+    }
+
+    if (!ready) {
+        shadowValid = false;
+    }
+
+    uint32_t elapsed = micros() - start;
+    lastSwitch[mode] = elapsed;
+    totalSwitch[mode] += elapsed;
+    switches[mode]++;
+    if (elapsed > maxSwitch[mode]) {
+        maxSwitch[mode] = elapsed;
+    }
+    return ready;
+}
+
+// Duration of the last switch to a mode in us
+uint32_t RadioModes::getLastSwitch(int mode) const {
+    return lastSwitch[mode];
+}
+
+// Average duration of the switches to a mode in us
+uint32_t RadioModes::getAverageSwitch(int mode) const {
+    return switches[mode] ? (uint32_t) (totalSwitch[mode] / switches[mode]) : 0;
+}
+
+// Longest switch to a mode in us
+uint32_t RadioModes::getMaxSwitch(int mode) const {
+    return maxSwitch[mode];
+}
+
+// Registers written by the switches to a mode
+uint32_t RadioModes::getRegistersWritten(int mode) const {
+    return registersWritten[mode];
+}
+
+// Switches where the chip did not reach the expected state in time
+uint32_t RadioModes::getTimeouts() const {
+    return timeouts;
+}
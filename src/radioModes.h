@@ -0,0 +1,69 @@
+// radioModes.h
+#ifndef RADIO_MODES_H
+#define RADIO_MODES_H
+
+#include <stdint.h>
+#include <rtl_433_ESP.h>
+
+#define RADIO_RX 0
+#define RADIO_TX 1
+#define RADIO_MODES 2
+
+#define RADIO_PROFILE_REGISTERS 0x23 // IOCFG2 .. FREND0, calibration and test registers are left to the chip
+#define RADIO_PATABLE_SIZE 8
+#define RADIO_BURST_GAP 2            // Unchanged registers written rather than starting a new burst
+#ifndef RADIO_STATE_TIMEOUT
+#  define RADIO_STATE_TIMEOUT 5000   // us to wait for the chip to reach a state
+#endif
+
+// CC1101 MARCSTATE values
+#define RADIO_MARCSTATE_MASK 0x1f
+#define RADIO_MARCSTATE_IDLE 0x01
+#define RADIO_MARCSTATE_RX 0x0d
+
+// CC1101 RX and TX configurations switched with burst writes
+//
+// The register file of each mode is captured once after RadioLib configured
+// it. A switch compares the profile with a shadow copy of the registers and
+// writes only the runs that differ, in one SPI transaction per run, and polls
+// MARCSTATE until the chip is ready instead of sleeping. Writes made behind
+// the shadow, e.g. by startTransmit(), must be reported with invalidate(),
+// the next switch then reads the registers back in one burst first.
+class RadioModes {
+private:
+    typedef struct {
+        uint8_t registers[RADIO_PROFILE_REGISTERS];
+        uint8_t patable[RADIO_PATABLE_SIZE];
+    } Profile;
+
+    CC1101& radio;
+    Profile profiles[RADIO_MODES];
+    Profile shadow;
+    bool shadowValid;
+
+    uint32_t switches[RADIO_MODES];
+    uint32_t lastSwitch[RADIO_MODES];     // us
+    uint32_t maxSwitch[RADIO_MODES];      // us
+    uint64_t totalSwitch[RADIO_MODES];    // us
+    uint32_t registersWritten[RADIO_MODES];
+    uint32_t timeouts;
+
+    void read(Profile& profile);
+    void write(int mode);
+    bool waitState(uint8_t state);
+
+public:
+    RadioModes(CC1101& radio);
+
+    void capture(int mode);
+    void invalidate();
+    bool apply(int mode);
+
+    uint32_t getLastSwitch(int mode) const;
+    uint32_t getAverageSwitch(int mode) const;
+    uint32_t getMaxSwitch(int mode) const;
+    uint32_t getRegistersWritten(int mode) const;
+    uint32_t getTimeouts() const;
+};
+
+#endif // RADIO_MODES_H
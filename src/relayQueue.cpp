@@ -0,0 +1,351 @@
+#include "relayQueue.h"
+
+// Hash of the protocol and sensor id
+static inline uint32_t hashKey(uint8_t protocol, uint32_t id) {
+    uint32_t key = id ^ ((uint32_t) protocol << 24);
+    key *= 2654435761u;
+    return key ^ (key >> 16);
+}
+
+// Share of airtime in ppm an entry asks for, us on air per ms of interval
+static inline uint32_t entryLoad(const RelayEntry& entry) {
+    return entry.interval ? (uint32_t) entry.airtime * 1000 / entry.interval : 0;
+}
+
+// Constructor
+RelayQueue::RelayQueue(int capacity, int maxRetrans, uint32_t airtimeBudget)
+    : capacity(capacity),
+      queueSize(0),
+      changeCount(0),
+      maxRetransmissions(maxRetrans),
+      airtimeBudget(airtimeBudget),
+      plannedLoad(0),
+      totalAirtime(0) {
+    // Keep the hash table at most half full
+    int tableSize = 1;
+    while (tableSize < capacity * 2) {
+        tableSize <<= 1;
+    }
+    tableMask = tableSize - 1;
+
+    receiveQueue = new RelayEntry[capacity];
+    heapPosition = new int[capacity];
+    dueHeap = new int[capacity];
+    idTable = new int[tableSize];
+
+    memset(receiveQueue, 0, sizeof(RelayEntry) * capacity);
+    for (int i = 0; i < tableSize; i++) {
+        idTable[i] = EMPTY_SLOT;
+    }
+
+    lock = portMUX_INITIALIZER_UNLOCKED;
+}
+
+RelayQueue::~RelayQueue() {
+    delete[] receiveQueue;
+    delete[] heapPosition;
+    delete[] dueHeap;
+    delete[] idTable;
+}
+
+// Find the hash slot holding the sensor, or the empty slot where it belongs
+int RelayQueue::findSlot(uint8_t protocol, uint32_t id) const {
+    int slot = hashKey(protocol, id) & tableMask;
+
+    while (idTable[slot] != EMPTY_SLOT &&
+           (receiveQueue[idTable[slot]].id != id || receiveQueue[idTable[slot]].protocol != protocol)) {
+        slot = (slot + 1) & tableMask;
+    }
+
+    return slot;
+}
+
+// Free a hash slot, shifting back following entries of the probe sequence
+void RelayQueue::removeSlot(int slot) {
+    int hole = slot;
+    int next = (slot + 1) & tableMask;
+
+    while (idTable[next] != EMPTY_SLOT) {
+        const RelayEntry& entry = receiveQueue[idTable[next]];
+        int home = hashKey(entry.protocol, entry.id) & tableMask;
+
+        // Move the entry into the hole unless its home lies in (hole, next]
+        if (((next - home) & tableMask) >= ((next - hole) & tableMask)) {
+            idTable[hole] = idTable[next];
+            hole = next;
+        }
+        next = (next + 1) & tableMask;
+    }
+
+    idTable[hole] = EMPTY_SLOT;
+}
+
+bool RelayQueue::isEarlier(int heapA, int heapB) const {
+    return receiveQueue[dueHeap[heapA]].timestamp < receiveQueue[dueHeap[heapB]].timestamp;
+}
+
+void RelayQueue::swapHeap(int heapA, int heapB) {
+    int entryA = dueHeap[heapA];
+    int entryB = dueHeap[heapB];
+
+    dueHeap[heapA] = entryB;
+    dueHeap[heapB] = entryA;
+    heapPosition[entryA] = heapB;
+    heapPosition[entryB] = heapA;
+}
+
+void RelayQueue::siftUp(int pos) {
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (!isEarlier(pos, parent)) {
+            break;
+        }
+        swapHeap(pos, parent);
+        pos = parent;
+    }
+}
+
+void RelayQueue::siftDown(int pos) {
+    for (;;) {
+        int earliest = pos;
+        int left = 2 * pos + 1;
+        int right = left + 1;
+
+        if (left < queueSize && isEarlier(left, earliest)) {
+            earliest = left;
+        }
+        if (right < queueSize && isEarlier(right, earliest)) {
+            earliest = right;
+        }
+        if (earliest == pos) {
+            break;
+        }
+        swapHeap(pos, earliest);
+        pos = earliest;
+    }
+}
+
+// Remove an entry, the last entry is moved into its place
+void RelayQueue::removeEntry(int index) {
+    changeCount++;
+    plannedLoad -= entryLoad(receiveQueue[index]);
+    removeSlot(findSlot(receiveQueue[index].protocol, receiveQueue[index].id));
+
+    // Remove from the heap
+    int pos = heapPosition[index];
+    int lastPos = queueSize - 1;
+    if (pos != lastPos) {
+        swapHeap(pos, lastPos);
+    }
+
+    queueSize--;
+    if (pos < queueSize) {
+        siftDown(pos);
+        siftUp(pos);
+    }
+
+    // Keep the entries dense
+    int last = queueSize;
+    if (index != last) {
+        receiveQueue[index] = receiveQueue[last];
+        heapPosition[index] = heapPosition[last];
+        dueHeap[heapPosition[index]] = index;
+        idTable[findSlot(receiveQueue[index].protocol, receiveQueue[index].id)] = index;
+    }
+}
+
+// Retransmission interval of an entry, stretched when over the airtime budget
+time_t RelayQueue::scaledInterval(const RelayEntry& entry) const {
+    if (airtimeBudget == 0 || plannedLoad <= airtimeBudget) {
+        return entry.interval;
+    }
+    return (time_t) ((uint64_t) entry.interval * plannedLoad / airtimeBudget);
+}
+
+// Add or update an entry in the queue from a new reading
+bool RelayQueue::addOrUpdateEntry(const RelayEntry& reading, time_t now) {
+    RelayEntry entry = reading;
+    entry.timestamp = now + reading.interval;
+    entry.received = now;
+    entry.retransmit_count = 0;
+    entry.airtimeUsed = 0;
+
+    return storeEntry(entry, true);
+}
+
+// Restore an entry with its retransmission state, e.g. after a restart
+bool RelayQueue::restoreEntry(const RelayEntry& entry) {
+    return storeEntry(entry, false);
+}
+
+bool RelayQueue::storeEntry(RelayEntry entry, bool keepAirtimeUsed) {
+    if (entry.frameSize > RELAY_FRAME_SIZE) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&lock);
+
+    int slot = findSlot(entry.protocol, entry.id);
+    int index = idTable[slot];
+    bool stored = index != EMPTY_SLOT;
+
+    if (stored) {
+        // Update, the sensor keeps its airtime total
+        plannedLoad -= entryLoad(receiveQueue[index]);
+        if (keepAirtimeUsed) {
+            entry.airtimeUsed = receiveQueue[index].airtimeUsed;
+        }
+    } else if (queueSize < capacity) {
+        // Add a new entry
+        index = queueSize++;
+        idTable[slot] = index;
+        dueHeap[index] = index;
+        heapPosition[index] = index;
+        stored = true;
+    }
+
+    if (stored) {
+        receiveQueue[index] = entry;
+        plannedLoad += entryLoad(entry);
+        changeCount++;
+
+        siftUp(heapPosition[index]);
+        siftDown(heapPosition[index]);
+    }
+
+    portEXIT_CRITICAL(&lock);
+
+    return stored; // False if the queue is full
+}
+
+// Copy out the entry of a sensor, false if not in the queue
+bool RelayQueue::findEntry(uint8_t protocol, uint32_t id, RelayEntry& entry) const {
+    portENTER_CRITICAL(&lock);
+    int index = idTable[findSlot(protocol, id)];
+    if (index != EMPTY_SLOT) {
+        entry = receiveQueue[index];
+    }
+    portEXIT_CRITICAL(&lock);
+
+    return index != EMPTY_SLOT;
+}
+
+// Get the frame of the next entry to retransmit, returns its size or 0
+int RelayQueue::getNextEntryToRetransmit(uint8_t* frameBuffer, time_t now) {
+    portENTER_CRITICAL(&lock);
+
+    if (queueSize == 0 || receiveQueue[dueHeap[0]].timestamp >= now) {
+        portEXIT_CRITICAL(&lock);
+        return 0;
+    }
+
+    int index = dueHeap[0];
+    RelayEntry& entry = receiveQueue[index];
+
+    // Copied while locked, the decoder task may update the entry meanwhile
+    int frameSize = entry.frameSize;
+    memcpy(frameBuffer, entry.frame, frameSize);
+
+    uint32_t airtime = (entry.airtime + 500) / 1000;
+    entry.airtimeUsed += airtime;
+    totalAirtime += airtime;
+
+    entry.retransmit_count++;
+    entry.timestamp = now + scaledInterval(entry);
+    changeCount++; // Retransmission state is checkpointed too
+
+    if ((int) entry.retransmit_count > maxRetransmissions) {
+        removeEntry(index);
+    } else {
+        siftDown(0);
+    }
+
+    portEXIT_CRITICAL(&lock);
+
+    return frameSize;
+}
+
+// Check if an entry is due for retransmission
+bool RelayQueue::isEntryDue(time_t now) const {
+    portENTER_CRITICAL(&lock);
+    bool due = queueSize > 0 && receiveQueue[dueHeap[0]].timestamp < now;
+    portEXIT_CRITICAL(&lock);
+
+    return due;
+}
+
+// Postpone unchanged entries due before now by delay, so changed readings go
+// first. Not counted as a retransmission, returns the number of entries postponed
+int RelayQueue::deferUnchangedEntries(time_t now, time_t delay) {
+    int deferred = 0;
+
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < queueSize; i++) {
+        if (!receiveQueue[i].changed && receiveQueue[i].timestamp < now) {
+            receiveQueue[i].timestamp = now + delay;
+            siftDown(heapPosition[i]);
+            deferred++;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+
+    return deferred;
+}
+
+// Print an entry of the queue into buffer, false if index is out of range
+bool RelayQueue::formatEntry(int index, char* buffer, size_t size) const {
+    RelayEntry entry;
+
+    portENTER_CRITICAL(&lock);
+    bool valid = index >= 0 && index < queueSize;
+    if (valid) {
+        entry = receiveQueue[index];
+    }
+    portEXIT_CRITICAL(&lock);
+
+    if (!valid) {
+        return false;
+    }
+    snprintf(buffer, size,
+             "%06X | %d kPa | %d | %lu ms",
+             (unsigned) entry.id,
+             entry.pressure,
+             entry.retransmit_count,
+             (unsigned long) entry.airtimeUsed);
+    return true;
+}
+
+// Copy out all entries, returns the number copied
+int RelayQueue::copyEntries(RelayEntry* entries, int maxEntries) const {
+    portENTER_CRITICAL(&lock);
+    int count = queueSize < maxEntries ? queueSize : maxEntries;
+    memcpy(entries, receiveQueue, sizeof(RelayEntry) * count);
+    portEXIT_CRITICAL(&lock);
+
+    return count;
+}
+
+// Number of entries added, updated or removed since start
+uint32_t RelayQueue::getChangeCount() const {
+    return changeCount;
+}
+
+// Time on air of all relays in ms
+uint32_t RelayQueue::getTotalAirtime() const {
+    return totalAirtime;
+}
+
+// Share of airtime in ppm the entries ask for at their own intervals
+uint32_t RelayQueue::getPlannedLoad() const {
+    return plannedLoad;
+}
+
+// Get the current queue size
+int RelayQueue::getQueueSize() const {
+    return queueSize;
+}
+
+// Get the maximum number of entries
+int RelayQueue::getCapacity() const {
+    return capacity;
+}
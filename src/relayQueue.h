@@ -0,0 +1,74 @@
+// relayQueue.h
+#ifndef RELAY_QUEUE_H
+#define RELAY_QUEUE_H
+
+#include "relay_entry.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <string.h>
+#include <stdio.h>
+#include "AM_ESP32Ble.h"
+
+// Relay table of received sensors
+//
+// Entries are stored densely in receiveQueue[0, queueSize). An open addressed
+// hash table maps the (protocol, sensor id) pair to its entry, and a binary
+// min-heap of entry indices ordered by timestamp gives the next entry due, so
+// a lookup is O(1) and selecting / rescheduling the next retransmission is
+// O(log n).
+//
+// Each entry has its own retransmission interval. When the entries together
+// would keep the transmitter on for more than the airtime budget, all
+// intervals are stretched by the same factor to fit.
+class RelayQueue {
+private:
+    static const int EMPTY_SLOT = -1;
+
+    RelayEntry* receiveQueue;       // Entries, [0, queueSize)
+    int* heapPosition;              // Position of each entry in dueHeap
+    int* dueHeap;                   // Entry indices, min-heap on timestamp
+    int* idTable;                   // Entry index per hash slot or EMPTY_SLOT
+    int tableMask;                  // Hash table size - 1, size is a power of two
+    int capacity;
+    int queueSize;
+    volatile uint32_t changeCount;  // Entries added, updated, retransmitted or removed
+    int maxRetransmissions;
+    uint32_t airtimeBudget;         // Planned share of airtime in ppm
+    uint32_t plannedLoad;           // Share of airtime the entries ask for in ppm
+    uint32_t totalAirtime;          // Time on air of all relays in ms
+    mutable portMUX_TYPE lock;      // Shared with the decoder task callback
+
+    bool storeEntry(RelayEntry entry, bool keepAirtimeUsed);
+    time_t scaledInterval(const RelayEntry& entry) const;
+    int findSlot(uint8_t protocol, uint32_t id) const;
+    void removeSlot(int slot);
+    void removeEntry(int index);
+
+    bool isEarlier(int heapA, int heapB) const;
+    void swapHeap(int heapA, int heapB);
+    void siftUp(int pos);
+    void siftDown(int pos);
+
+public:
+    RelayQueue(int capacity, int maxRetrans, uint32_t airtimeBudget);
+    ~RelayQueue();
+
+    bool addOrUpdateEntry(const RelayEntry& reading, time_t now);
+    bool findEntry(uint8_t protocol, uint32_t id, RelayEntry& entry) const;
+    int getNextEntryToRetransmit(uint8_t* frameBuffer, time_t now);
+    bool isEntryDue(time_t now) const;
+    int deferUnchangedEntries(time_t now, time_t delay);
+    bool formatEntry(int index, char* buffer, size_t size) const;
+
+    bool restoreEntry(const RelayEntry& entry);
+    int copyEntries(RelayEntry* entries, int maxEntries) const;
+    uint32_t getChangeCount() const;
+    uint32_t getTotalAirtime() const;
+    uint32_t getPlannedLoad() const;
+
+    int getQueueSize() const;
+    int getCapacity() const;
+};
+
+#endif // RELAY_QUEUE_H
@@ -0,0 +1,166 @@
+#include "relayStore.h"
+#include <time.h>
+
+#define RELAY_STORE_NAMESPACE "relay"
+#define RELAY_STORE_KEY "queue"
+#define RELAY_STORE_VERSION 4
+
+// Blob header: version, entry count, system clock in s at the checkpoint
+#define RELAY_STORE_HEADER_SIZE 7
+
+// Stored entry, followed by frameSize bytes of frame
+typedef struct __attribute__((packed)) {
+    uint32_t id;
+    int32_t dueIn;              // ms from the checkpoint until the entry is due
+    uint32_t age;               // s from receiving the reading until the checkpoint
+    uint32_t interval;
+    uint32_t airtimeUsed;
+    int16_t pressure;
+    uint16_t airtime;
+    uint16_t retransmitCount;
+    uint8_t protocol;
+    uint8_t frameSize;
+    uint8_t changed;
+} RelayRecord;
+
+// Constructor
+RelayStore::RelayStore(unsigned long checkpointInterval, uint32_t maxAge)
+    : entries(NULL),
+      blob(NULL),
+      capacity(0),
+      interval(checkpointInterval),
+      maxAge(maxAge),
+      lastCheckpoint(0),
+      savedChangeCount(0) {
+}
+
+RelayStore::~RelayStore() {
+    preferences.end();
+    delete[] entries;
+    delete[] blob;
+}
+
+// Open the NVS namespace and allocate buffers for a queue of capacity entries
+bool RelayStore::begin(int queueCapacity) {
+    capacity = queueCapacity;
+    entries = new RelayEntry[capacity];
+    blob = new uint8_t[RELAY_STORE_HEADER_SIZE + capacity * (sizeof(RelayRecord) + RELAY_FRAME_SIZE)];
+
+    return preferences.begin(RELAY_STORE_NAMESPACE, false);
+}
+
+// Load the last checkpoint into the queue, returns the number of entries restored
+int RelayStore::restore(RelayQueue& queue, int protocolCount, time_t now) {
+    size_t maxSize = RELAY_STORE_HEADER_SIZE + capacity * (sizeof(RelayRecord) + RELAY_FRAME_SIZE);
+    size_t size = preferences.getBytesLength(RELAY_STORE_KEY);
+    int restored = 0;
+
+    lastCheckpoint = now;
+
+    if (size < RELAY_STORE_HEADER_SIZE || size > maxSize ||
+        preferences.getBytes(RELAY_STORE_KEY, blob, size) != size ||
+        blob[0] != RELAY_STORE_VERSION) {
+        savedChangeCount = queue.getChangeCount();
+        return 0;
+    }
+
+    int count = blob[1] | (blob[2] << 8);
+    uint32_t saved = blob[3] | (blob[4] << 8) | (blob[5] << 16) | ((uint32_t) blob[6] << 24);
+    uint32_t seconds = (uint32_t) time(NULL);
+    size_t pos = RELAY_STORE_HEADER_SIZE;
+
+    // The clock started over, the relay was powered off for an unknown time
+    if (seconds < saved) {
+        savedChangeCount = queue.getChangeCount();
+        return 0;
+    }
+    uint32_t off = seconds - saved;
+
+    for (int i = 0; i < count && pos + sizeof(RelayRecord) <= size; i++) {
+        RelayRecord record;
+        memcpy(&record, blob + pos, sizeof(record));
+        pos += sizeof(record);
+
+        if (record.frameSize > RELAY_FRAME_SIZE || pos + record.frameSize > size) {
+            break;
+        }
+
+        // Skip entries of protocols no longer relayed, and stale readings
+        uint32_t age = record.age + off;
+        if (record.protocol < protocolCount && age <= maxAge) {
+            RelayEntry entry;
+            memcpy(entry.frame, blob + pos, record.frameSize);
+            entry.frameSize = record.frameSize;
+            entry.protocol = record.protocol;
+            entry.changed = record.changed;
+            entry.id = record.id;
+            entry.pressure = record.pressure;
+            entry.airtime = record.airtime;
+            entry.interval = record.interval;
+            entry.airtimeUsed = record.airtimeUsed;
+            entry.timestamp = now + (record.dueIn > 0 ? record.dueIn : 0);
+            entry.received = now - (time_t) age * 1000;
+            entry.retransmit_count = record.retransmitCount;
+
+            if (queue.restoreEntry(entry)) {
+                restored++;
+            }
+        }
+        pos += record.frameSize;
+    }
+
+    savedChangeCount = queue.getChangeCount();
+    return restored;
+}
+
+// Write a checkpoint if the interval has passed and the queue has changed
+bool RelayStore::checkpoint(const RelayQueue& queue, time_t now) {
+    if (interval == 0 || blob == NULL || (unsigned long) (now - lastCheckpoint) < interval) {
+        return false;
+    }
+    lastCheckpoint = now;
+
+    uint32_t changeCount = queue.getChangeCount();
+    if (changeCount == savedChangeCount) {
+        return false;
+    }
+
+    int count = queue.copyEntries(entries, capacity);
+    size_t pos = RELAY_STORE_HEADER_SIZE;
+
+    blob[0] = RELAY_STORE_VERSION;
+    blob[1] = count & 0xff;
+    blob[2] = count >> 8;
+    uint32_t seconds = (uint32_t) time(NULL);
+    blob[3] = seconds & 0xff;
+    blob[4] = (seconds >> 8) & 0xff;
+    blob[5] = (seconds >> 16) & 0xff;
+    blob[6] = seconds >> 24;
+
+    for (int i = 0; i < count; i++) {
+        RelayRecord record;
+        record.id = entries[i].id;
+        record.dueIn = entries[i].timestamp - now;
+        record.age = (uint32_t) (now - entries[i].received) / 1000;
+        record.interval = entries[i].interval;
+        record.airtimeUsed = entries[i].airtimeUsed;
+        record.pressure = entries[i].pressure;
+        record.airtime = entries[i].airtime;
+        record.retransmitCount = entries[i].retransmit_count;
+        record.protocol = entries[i].protocol;
+        record.frameSize = entries[i].frameSize;
+        record.changed = entries[i].changed;
+
+        memcpy(blob + pos, &record, sizeof(record));
+        pos += sizeof(record);
+        memcpy(blob + pos, entries[i].frame, record.frameSize);
+        pos += record.frameSize;
+    }
+
+    if (preferences.putBytes(RELAY_STORE_KEY, blob, pos) != pos) {
+        return false;
+    }
+
+    savedChangeCount = changeCount;
+    return true;
+}
@@ -0,0 +1,41 @@
+// relayStore.h
+#ifndef RELAY_STORE_H
+#define RELAY_STORE_H
+
+#include <Preferences.h>
+#include "relayQueue.h"
+
+// Checkpoint of the relay queue in NVS, so relaying resumes right after a
+// restart instead of once every sensor has transmitted again
+//
+// The queue is written as one blob of compact records (frame, id, cadence
+// and retransmission state, due time relative to the checkpoint). NVS appends
+// each write to its log and wear levels the pages, so flash wear is bounded
+// by the checkpoint interval; checkpoints are only written when the queue
+// has changed.
+//
+// Readings older than the maximum age are not restored. The age counts the
+// time the relay was off through the system clock, which keeps running
+// across software resets but starts over on power up; after a power loss
+// the time off is unknown and nothing is restored.
+class RelayStore {
+private:
+    Preferences preferences;
+    RelayEntry* entries;
+    uint8_t* blob;
+    int capacity;
+    unsigned long interval;
+    uint32_t maxAge;               // s
+    unsigned long lastCheckpoint;
+    uint32_t savedChangeCount;
+
+public:
+    RelayStore(unsigned long checkpointInterval, uint32_t maxAge);
+    ~RelayStore();
+
+    bool begin(int capacity);
+    int restore(RelayQueue& queue, int protocolCount, time_t now);
+    bool checkpoint(const RelayQueue& queue, time_t now);
+};
+
+#endif // RELAY_STORE_H
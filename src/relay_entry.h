@@ -0,0 +1,27 @@
+// relay_entry.h
+#ifndef RELAY_ENTRY_H
+#define RELAY_ENTRY_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define RELAY_FRAME_SIZE 24     // Largest frame of a relayed protocol
+
+// Received sensor, holding the frame to transmit as built once by the encoder
+// of its protocol (see relay_protocols.h) when the reading was received
+typedef struct {
+    uint8_t frame[RELAY_FRAME_SIZE]; // Frame as written to the TX FIFO
+    uint8_t frameSize;          // Number of valid frame bytes
+    uint8_t protocol;           // Index in the list of relayed protocols
+    uint8_t changed;            // Pressure differs from the previous reading, sent first when airtime is short
+    uint32_t id;                // Sensor id, unique per protocol
+    int16_t pressure;           // Pressure of the reading in kPa
+    uint16_t airtime;           // Time on air of the frame in us
+    uint32_t interval;          // Retransmission interval in ms, before budget scaling
+    uint32_t airtimeUsed;       // Time on air of all relays of this sensor in ms
+    time_t timestamp;           // Time the entry is due for retransmission
+    time_t received;            // Time the reading was received
+    uint32_t retransmit_count;  // Number of times the entry has been retransmitted
+} RelayEntry;
+
+#endif // RELAY_ENTRY_H
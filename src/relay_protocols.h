@@ -0,0 +1,171 @@
+// relay_protocols.h
+#ifndef RELAY_PROTOCOLS_H
+#define RELAY_PROTOCOLS_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Relayed protocols are described by a struct with
+//
+//   payloadSize                     bytes copied by the decoder
+//   frameSize                       bytes of the transmitted frame
+//   matches(data, size)             true if a received payload is of this protocol
+//   id(payload)                     sensor id
+//   pressure(payload)               pressure in kPa
+//   pressureRaw(payload)            pressure byte, as kept in the history
+//   temperatureRaw(payload)         temperature byte, as kept in the history
+//   pressureKpa(raw)                pressure in kPa of a pressure byte
+//   temperatureC(raw)               temperature in C of a temperature byte
+//   encode(payload, frame)          build the frame, returns its size
+//
+// and listed in RelayProtocols<...>. Lookups unroll at compile time into a
+// chain of direct calls, so there is no table of function pointers.
+//
+// All protocols are sent with the transmitter settings of setupTx()
+// (OOK, Manchester, BIT_RATE).
+
+// Schrader TPMS EG53MA4, PA66GF35
+// 10 byte payload: flags (starting 0x4C 0x90), id, pressure, temperature and
+// a sum checksum. The frame is preceded by 5 zero bytes.
+struct SchraderEG53MA4 {
+    static constexpr int syncSize = 5;
+    static constexpr int payloadSize = 10;
+    static constexpr int frameSize = syncSize + payloadSize;
+
+    static bool matches(const uint8_t* data, int size) {
+        if (size != payloadSize || data[0] != 0x4c || data[1] != 0x90) {
+            return false;
+        }
+
+        uint8_t checksum = 0;
+        for (int i = 0; i < payloadSize - 1; i++) {
+            checksum += data[i];
+        }
+        return checksum == data[payloadSize - 1];
+    }
+
+    static uint32_t id(const uint8_t* payload) {
+        return (payload[4] << 16) | (payload[5] << 8) | payload[6];
+    }
+
+    // 25 mbar per count
+    static int pressure(const uint8_t* payload) {
+        return payload[7] * 5 / 2;
+    }
+
+    static uint8_t pressureRaw(const uint8_t* payload) {
+        return payload[7];
+    }
+
+    // Degrees Fahrenheit
+    static uint8_t temperatureRaw(const uint8_t* payload) {
+        return payload[8];
+    }
+
+    static float pressureKpa(uint8_t raw) {
+        return raw * 2.5f;
+    }
+
+    static float temperatureC(uint8_t raw) {
+        return (raw - 32) * 5 / 9.0f;
+    }
+
+    static int encode(const uint8_t* payload, uint8_t* frame) {
+        memset(frame, 0, syncSize);
+        memcpy(frame + syncSize, payload, payloadSize);
+        return frameSize;
+    }
+};
+
+template <typename... Protocols>
+struct RelayProtocols;
+
+template <>
+struct RelayProtocols<> {
+    static constexpr int count = 0;
+    static constexpr int maxPayloadSize = 0;
+    static constexpr int maxFrameSize = 0;
+
+    static int match(const uint8_t*, int, int = 0) {
+        return -1;
+    }
+
+    static uint32_t id(int, const uint8_t*) {
+        return 0;
+    }
+
+    static int pressure(int, const uint8_t*) {
+        return 0;
+    }
+
+    static uint8_t pressureRaw(int, const uint8_t*) {
+        return 0;
+    }
+
+    static uint8_t temperatureRaw(int, const uint8_t*) {
+        return 0;
+    }
+
+    static float pressureKpa(int, uint8_t) {
+        return 0;
+    }
+
+    static float temperatureC(int, uint8_t) {
+        return 0;
+    }
+
+    static int encode(int, const uint8_t*, uint8_t*) {
+        return 0;
+    }
+};
+
+template <typename First, typename... Rest>
+struct RelayProtocols<First, Rest...> {
+    typedef RelayProtocols<Rest...> Next;
+
+    static constexpr int count = 1 + Next::count;
+    static constexpr int maxPayloadSize =
+        First::payloadSize > Next::maxPayloadSize ? First::payloadSize : Next::maxPayloadSize;
+    static constexpr int maxFrameSize =
+        First::frameSize > Next::maxFrameSize ? First::frameSize : Next::maxFrameSize;
+
+    // Index of the protocol of a received payload, -1 if not relayed
+    static int match(const uint8_t* data, int size, int index = 0) {
+        return First::matches(data, size) ? index : Next::match(data, size, index + 1);
+    }
+
+    // Sensor id of a payload of the protocol at index
+    static uint32_t id(int protocol, const uint8_t* payload) {
+        return protocol == 0 ? First::id(payload) : Next::id(protocol - 1, payload);
+    }
+
+    // Pressure in kPa of a payload of the protocol at index
+    static int pressure(int protocol, const uint8_t* payload) {
+        return protocol == 0 ? First::pressure(payload) : Next::pressure(protocol - 1, payload);
+    }
+
+    // Raw pressure and temperature of a payload of the protocol at index
+    static uint8_t pressureRaw(int protocol, const uint8_t* payload) {
+        return protocol == 0 ? First::pressureRaw(payload) : Next::pressureRaw(protocol - 1, payload);
+    }
+
+    static uint8_t temperatureRaw(int protocol, const uint8_t* payload) {
+        return protocol == 0 ? First::temperatureRaw(payload) : Next::temperatureRaw(protocol - 1, payload);
+    }
+
+    // Pressure in kPa and temperature in C of raw values of the protocol at index
+    static float pressureKpa(int protocol, uint8_t raw) {
+        return protocol == 0 ? First::pressureKpa(raw) : Next::pressureKpa(protocol - 1, raw);
+    }
+
+    static float temperatureC(int protocol, uint8_t raw) {
+        return protocol == 0 ? First::temperatureC(raw) : Next::temperatureC(protocol - 1, raw);
+    }
+
+    // Build the frame of a payload of the protocol at index, returns its size
+    static int encode(int protocol, const uint8_t* payload, uint8_t* frame) {
+        return protocol == 0 ? First::encode(payload, frame) : Next::encode(protocol - 1, payload, frame);
+    }
+};
+
+#endif // RELAY_PROTOCOLS_H
@@ -0,0 +1,116 @@
+#include "sensorActivity.h"
+#include <string.h>
+
+// Constructor
+SensorActivity::SensorActivity(uint32_t silenceFactor)
+    : count(0),
+      silenceFactor(silenceFactor),
+      lastReception(0),
+      lastReport(0),
+      silences(0) {
+    memset(sensors, 0, sizeof(sensors));
+    lock = portMUX_INITIALIZER_UNLOCKED;
+}
+
+// A sensor was received, learn its interval. When the table is full the
+// sensor heard least recently makes room
+void SensorActivity::heard(uint8_t protocol, uint32_t id, unsigned long now) {
+    portENTER_CRITICAL(&lock);
+    lastReception = now;
+
+    int slot = -1;
+    int oldest = 0;
+    for (int i = 0; i < count; i++) {
+        if (sensors[i].protocol == protocol && sensors[i].id == id) {
+            slot = i;
+            break;
+        }
+        if (now - sensors[i].lastHeard > now - sensors[oldest].lastHeard) {
+            oldest = i;
+        }
+    }
+
+    if (slot < 0) {
+        slot = count < SENSOR_ACTIVITY_SIZE ? count++ : oldest;
+        sensors[slot].protocol = protocol;
+        sensors[slot].id = id;
+        sensors[slot].lastHeard = now;
+        sensors[slot].interval = 0;
+        portEXIT_CRITICAL(&lock);
+        return;
+    }
+
+    Sensor& sensor = sensors[slot];
+    unsigned long gap = now - sensor.lastHeard;
+    sensor.lastHeard = now;
+
+    // Gaps of a sensor that had left would inflate the interval
+    if (gap >= SENSOR_MIN_GAP && (!sensor.interval || gap <= (unsigned long) SENSOR_GONE_FACTOR * sensor.interval)) {
+        if (sensor.interval == 0) {
+            sensor.interval = gap;
+        } else {
+            sensor.interval = (sensor.interval * (SENSOR_INTERVAL_WEIGHT - 1) + gap) / SENSOR_INTERVAL_WEIGHT;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+// Transmissions of the sensors that have not left that were expected since
+// the last reception or silence report, and are overdue now
+uint32_t SensorActivity::missedTransmissions(unsigned long now) const {
+    portENTER_CRITICAL(&lock);
+    uint32_t missed = countMissed(now);
+    portEXIT_CRITICAL(&lock);
+    return missed;
+}
+
+// missedTransmissions() with the lock held
+uint32_t SensorActivity::countMissed(unsigned long now) const {
+    unsigned long since = now - lastReport < now - lastReception ? lastReport : lastReception;
+    uint32_t missed = 0;
+
+    for (int i = 0; i < count; i++) {
+        const Sensor& sensor = sensors[i];
+        if (!sensor.interval || now - sensor.lastHeard >= (unsigned long) SENSOR_GONE_FACTOR * sensor.interval) {
+            continue;
+        }
+        // Expected at lastHeard + k * interval, counted in ( since, now - lateness ]
+        unsigned long overdue = now - sensor.lastHeard;
+        unsigned long lateness = sensor.interval / SENSOR_LATENESS;
+        if (overdue < lateness) {
+            continue;
+        }
+        uint32_t expected = (overdue - lateness) / sensor.interval;
+        uint32_t before = (since - sensor.lastHeard) / sensor.interval;
+        if (expected > before) {
+            missed += expected - before;
+        }
+    }
+    return missed;
+}
+
+// True once silenceFactor transmissions were missed without a reception,
+// the next report needs as many misses again
+bool SensorActivity::checkSilence(unsigned long now) {
+    portENTER_CRITICAL(&lock);
+    bool silent = countMissed(now) >= silenceFactor;
+    if (silent) {
+        lastReport = now;
+        silences++;
+    }
+    portEXIT_CRITICAL(&lock);
+    return silent;
+}
+
+// ms since the last reception
+unsigned long SensorActivity::getSilence(unsigned long now) const {
+    portENTER_CRITICAL(&lock);
+    unsigned long silence = now - lastReception;
+    portEXIT_CRITICAL(&lock);
+    return silence;
+}
+
+// Silences reported
+uint32_t SensorActivity::getSilences() const {
+    return silences;
+}
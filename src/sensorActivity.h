@@ -0,0 +1,58 @@
+// sensorActivity.h
+#ifndef SENSOR_ACTIVITY_H
+#define SENSOR_ACTIVITY_H
+
+#include <stdint.h>
+#include "AM_ESP32Ble.h"
+
+#define SENSOR_ACTIVITY_SIZE 32
+#define SENSOR_MIN_GAP 5000       // ms, receptions closer than this are repeats of one transmission
+#define SENSOR_GONE_FACTOR 10     // Sensors not heard for this many intervals have left
+#define SENSOR_INTERVAL_WEIGHT 4  // Weight of the learned interval against a new gap
+#define SENSOR_LATENESS 4         // A transmission is missed 1/4 interval after it was expected
+
+// Expected reception activity of the sensors around
+//
+// Every sensor learns its transmission interval from the gaps between its
+// receptions, which tells when its next transmissions are expected. Nothing
+// received while the sensors that have not left missed silenceFactor
+// expected transmissions between them points at a deaf receiver rather than
+// at lost transmissions. With more sensors around the misses add up faster,
+// so a deaf receiver is noticed sooner.
+//
+// A silence cannot be seen before an expected transmission is overdue, so it
+// takes from about one transmission interval with many sensors around up to
+// silenceFactor intervals with a single one, a minute or more for TPMS
+// sensors. This is deliberately slower than the receiver's own checks, which
+// find a transceiver that left RX or a stuck RSSI within seconds; only a
+// receiver that looks healthy but decodes nothing is left to this.
+class SensorActivity {
+private:
+    typedef struct {
+        uint8_t protocol;
+        uint32_t id;
+        unsigned long lastHeard;   // ms
+        uint32_t interval;         // ms, 0 until learned
+    } Sensor;
+
+    Sensor sensors[SENSOR_ACTIVITY_SIZE];
+    int count;
+    uint32_t silenceFactor;        // Missed transmissions before a silence is reported
+    unsigned long lastReception;   // ms
+    unsigned long lastReport;      // ms, last silence report
+    uint32_t silences;
+    mutable portMUX_TYPE lock;     // heard() runs in the decoder task callback
+
+    uint32_t countMissed(unsigned long now) const;
+
+public:
+    SensorActivity(uint32_t silenceFactor);
+
+    void heard(uint8_t protocol, uint32_t id, unsigned long now);
+    uint32_t missedTransmissions(unsigned long now) const;
+    bool checkSilence(unsigned long now);
+    unsigned long getSilence(unsigned long now) const;
+    uint32_t getSilences() const;
+};
+
+#endif // SENSOR_ACTIVITY_H
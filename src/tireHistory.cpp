@@ -0,0 +1,371 @@
+#include "tireHistory.h"
+
+// Largest encoded sample: 5 byte varint time delta, pressure, temperature
+#define HISTORY_MAX_SAMPLE 7
+
+// Constructor
+TireHistory::TireHistory()
+    : pendingHead(0),
+      pendingTail(0),
+      enabled(false),
+      droppedSamples(0) {
+    memset(cache, 0, sizeof(cache));
+    lock = portMUX_INITIALIZER_UNLOCKED;
+}
+
+// Start recording, once the SD card is mounted
+void TireHistory::begin() {
+    enabled = true;
+}
+
+// File of a sensor, 8.3 name from the protocol and the low 24 bits of the id
+void TireHistory::fileName(uint8_t protocol, uint32_t id, char* name, size_t size) {
+    snprintf(name, size, "/%02X%06lX.TSD", protocol, (unsigned long) (id & 0xffffff));
+}
+
+// Queue a reading, called from the decoder task. False if the queue is full
+bool TireHistory::record(uint8_t protocol, uint32_t id, const HistoryPoint& point) {
+    if (!enabled) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&lock);
+    int next = (pendingHead + 1) % HISTORY_PENDING;
+    bool queued = next != pendingTail;
+    if (queued) {
+        pending[pendingHead].protocol = protocol;
+        pending[pendingHead].id = id;
+        pending[pendingHead].point = point;
+        pendingHead = next;
+    } else {
+        droppedSamples++;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    return queued;
+}
+
+// Write queued readings and blocks changed more than HISTORY_FLUSH_INTERVAL ago
+void TireHistory::loop() {
+    for (;;) {
+        PendingSample sample;
+
+        portENTER_CRITICAL(&lock);
+        bool available = pendingTail != pendingHead;
+        if (available) {
+            sample = pending[pendingTail];
+            pendingTail = (pendingTail + 1) % HISTORY_PENDING;
+        }
+        portEXIT_CRITICAL(&lock);
+
+        if (!available) {
+            break;
+        }
+        append(sample.protocol, sample.id, sample.point);
+    }
+
+    for (int i = 0; i < HISTORY_CACHED; i++) {
+        if (cache[i].dirty && millis() - cache[i].dirtySince >= HISTORY_FLUSH_INTERVAL) {
+            writeBlock(cache[i]);
+        }
+    }
+}
+
+// Write all changed blocks
+void TireHistory::flush() {
+    for (int i = 0; i < HISTORY_CACHED; i++) {
+        if (cache[i].dirty) {
+            writeBlock(cache[i]);
+        }
+    }
+}
+
+// Last block of a sensor, from the cache or read from its file
+TireHistory::CachedBlock* TireHistory::loadBlock(uint8_t protocol, uint32_t id) {
+    CachedBlock* entry = NULL;
+
+    for (int i = 0; i < HISTORY_CACHED; i++) {
+        if (cache[i].used && cache[i].protocol == protocol && cache[i].id == id) {
+            cache[i].lastUsed = millis();
+            return &cache[i];
+        }
+    }
+
+    // Take a free entry or the least recently used one
+    entry = &cache[0];
+    for (int i = 0; i < HISTORY_CACHED && entry->used; i++) {
+        if (!cache[i].used || millis() - cache[i].lastUsed > millis() - entry->lastUsed) {
+            entry = &cache[i];
+        }
+    }
+    if (entry->dirty && !writeBlock(*entry)) {
+        return NULL;
+    }
+
+    char name[16];
+    fileName(protocol, id, name, sizeof(name));
+
+    entry->used = false;
+    entry->protocol = protocol;
+    entry->id = id;
+    entry->blockIndex = 0;
+    memset(entry->block, 0, HISTORY_BLOCK_SIZE);
+
+    File file = SD.open(name, FILE_READ);
+    if (file) {
+        uint32_t blocks = file.size() / HISTORY_BLOCK_SIZE;
+        if (blocks > 0) {
+            entry->blockIndex = blocks - 1;
+            file.seek(entry->blockIndex * HISTORY_BLOCK_SIZE);
+            if (file.read(entry->block, HISTORY_BLOCK_SIZE) != HISTORY_BLOCK_SIZE) {
+                file.close();
+                return NULL;
+            }
+        }
+        file.close();
+    }
+
+    entry->used = true;
+    entry->dirty = false;
+    entry->lastUsed = millis();
+    return entry;
+}
+
+// Write a cached block in place, as one sector
+bool TireHistory::writeBlock(CachedBlock& cached) {
+    char name[16];
+    fileName(cached.protocol, cached.id, name, sizeof(name));
+
+    if (!SD.exists(name)) {
+        File created = SD.open(name, FILE_WRITE);
+        if (!created) {
+            return false;
+        }
+        created.close();
+    }
+
+    File file = SD.open(name, "r+");
+    if (!file) {
+        return false;
+    }
+
+    bool written = file.seek(cached.blockIndex * HISTORY_BLOCK_SIZE) &&
+                   file.write(cached.block, HISTORY_BLOCK_SIZE) == HISTORY_BLOCK_SIZE;
+    file.close();
+
+    if (written) {
+        cached.dirty = false;
+    }
+    return written;
+}
+
+// Add a sample to the last block of a sensor, starting a new block when full
+void TireHistory::append(uint8_t protocol, uint32_t id, const HistoryPoint& point) {
+    CachedBlock* cached = loadBlock(protocol, id);
+    if (cached == NULL) {
+        droppedSamples++;
+        return;
+    }
+
+    HistoryHeader header;
+    memcpy(&header, cached->block, sizeof(header));
+
+    // Blocks must stay in time order, e.g. after the clock was set back
+    if (header.count > 0 && point.time < header.lastTime) {
+        droppedSamples++;
+        return;
+    }
+
+    if (sizeof(header) + header.used + HISTORY_MAX_SAMPLE > HISTORY_BLOCK_SIZE) {
+        if (!writeBlock(*cached)) {
+            droppedSamples++;
+            return;
+        }
+        cached->blockIndex++;
+        memset(cached->block, 0, HISTORY_BLOCK_SIZE);
+        memset(&header, 0, sizeof(header));
+    }
+
+    if (header.count == 0) {
+        header.firstTime = point.time;
+        header.lastTime = point.time;
+    }
+
+    uint8_t* sample = cached->block + sizeof(header) + header.used;
+    uint32_t delta = point.time - header.lastTime;
+    int size = 0;
+
+    do {
+        uint8_t bits = delta & 0x7f;
+        delta >>= 7;
+        sample[size++] = bits | (delta ? 0x80 : 0);
+    } while (delta);
+    sample[size++] = point.pressureRaw;
+    sample[size++] = point.temperatureRaw;
+
+    header.lastTime = point.time;
+    header.count++;
+    header.used += size;
+    memcpy(cached->block, &header, sizeof(header));
+
+    if (!cached->dirty) {
+        cached->dirty = true;
+        cached->dirtySince = millis();
+    }
+}
+
+bool TireHistory::readHeader(File& file, uint32_t index, HistoryHeader& header) {
+    return file.seek(index * HISTORY_BLOCK_SIZE) &&
+           file.read((uint8_t*) &header, sizeof(header)) == sizeof(header);
+}
+
+// Samples of a sensor in [from, to] averaged into at most maxPoints equal
+// time buckets, returns the number of points
+int TireHistory::query(uint8_t protocol, uint32_t id, uint32_t from, uint32_t to, HistoryPoint* points, int maxPoints) {
+    if (!enabled || maxPoints <= 0 || to < from) {
+        return 0;
+    }
+
+    // The file has to hold the latest samples
+    for (int i = 0; i < HISTORY_CACHED; i++) {
+        if (cache[i].used && cache[i].dirty && cache[i].protocol == protocol && cache[i].id == id) {
+            writeBlock(cache[i]);
+        }
+    }
+
+    char name[16];
+    fileName(protocol, id, name, sizeof(name));
+
+    File file = SD.open(name, FILE_READ);
+    if (!file) {
+        return 0;
+    }
+
+    uint32_t blocks = file.size() / HISTORY_BLOCK_SIZE;
+    HistoryHeader header;
+
+    // First block ending at or after from
+    uint32_t low = 0;
+    uint32_t high = blocks;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (!readHeader(file, middle, header)) {
+            file.close();
+            return 0;
+        }
+        if (header.lastTime < from) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    uint32_t first = low;
+
+    // First block starting after to
+    high = blocks;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (!readHeader(file, middle, header)) {
+            file.close();
+            return 0;
+        }
+        if (header.firstTime <= to) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    uint32_t last = low;
+
+    if (first >= last) {
+        file.close();
+        return 0;
+    }
+
+    // Buckets cover the part of the range holding data
+    if (readHeader(file, first, header) && header.firstTime > from) {
+        from = header.firstTime;
+    }
+    if (readHeader(file, last - 1, header) && header.lastTime < to) {
+        to = header.lastTime;
+    }
+
+    // Read at most maxPoints blocks spread over the range
+    uint32_t stride = (last - first + maxPoints - 1) / maxPoints;
+    uint64_t span = (uint64_t) to - from + 1;
+
+    struct Bucket {
+        uint64_t time;
+        uint32_t pressure;
+        uint32_t temperature;
+        uint32_t count;
+    };
+    Bucket* buckets = new Bucket[maxPoints];
+    uint8_t* block = new uint8_t[HISTORY_BLOCK_SIZE];
+    memset(buckets, 0, sizeof(Bucket) * maxPoints);
+
+    for (uint32_t index = first; index < last; index += stride) {
+        if (!file.seek(index * HISTORY_BLOCK_SIZE) ||
+            file.read(block, HISTORY_BLOCK_SIZE) != HISTORY_BLOCK_SIZE) {
+            break;
+        }
+        memcpy(&header, block, sizeof(header));
+
+        uint32_t time = header.firstTime;
+        int pos = sizeof(header);
+        int end = sizeof(header) + header.used;
+        if (end > HISTORY_BLOCK_SIZE) {
+            continue;
+        }
+
+        for (int i = 0; i < header.count; i++) {
+            uint32_t delta = 0;
+            int shift = 0;
+            while (pos < end && shift < 35) {
+                uint8_t bits = block[pos++];
+                delta |= (uint32_t) (bits & 0x7f) << shift;
+                shift += 7;
+                if (!(bits & 0x80)) {
+                    break;
+                }
+            }
+            if (pos + 2 > end) {
+                break;
+            }
+            time += delta;
+            uint8_t pressure = block[pos++];
+            uint8_t temperature = block[pos++];
+
+            if (time < from || time > to) {
+                continue;
+            }
+            Bucket& bucket = buckets[(uint64_t) (time - from) * maxPoints / span];
+            bucket.time += time - from;
+            bucket.pressure += pressure;
+            bucket.temperature += temperature;
+            bucket.count++;
+        }
+    }
+    file.close();
+
+    int count = 0;
+    for (int i = 0; i < maxPoints; i++) {
+        const Bucket& bucket = buckets[i];
+        if (bucket.count == 0) {
+            continue;
+        }
+        points[count].time = from + (uint32_t) (bucket.time / bucket.count);
+        points[count].pressureRaw = (bucket.pressure + bucket.count / 2) / bucket.count;
+        points[count].temperatureRaw = (bucket.temperature + bucket.count / 2) / bucket.count;
+        count++;
+    }
+
+    delete[] buckets;
+    delete[] block;
+    return count;
+}
+
+// Readings lost to a full queue, a clock set back or SD errors
+uint32_t TireHistory::getDroppedSamples() const {
+    return droppedSamples;
+}
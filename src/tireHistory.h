@@ -0,0 +1,81 @@
+// tireHistory.h
+#ifndef TIRE_HISTORY_H
+#define TIRE_HISTORY_H
+
+#include <stdint.h>
+#include "AM_ESP32Ble.h"
+
+#define HISTORY_BLOCK_SIZE 512      // Bytes per block, one SD sector
+#define HISTORY_CACHED 4            // Sensors whose last block is kept in RAM
+#define HISTORY_PENDING 16          // Readings waiting to be written by loop()
+#define HISTORY_FLUSH_INTERVAL 60000 // ms a changed block stays in RAM at most
+
+// Block header, followed by the samples
+typedef struct __attribute__((packed)) {
+    uint32_t firstTime;         // Time of the first sample in s
+    uint32_t lastTime;          // Time of the last sample in s
+    uint16_t count;             // Number of samples
+    uint16_t used;              // Bytes of samples
+} HistoryHeader;
+
+// Sample, or the average of the samples of a query bucket
+typedef struct {
+    uint32_t time;
+    uint8_t pressureRaw;
+    uint8_t temperatureRaw;
+} HistoryPoint;
+
+// Pressure and temperature history per sensor on SD
+//
+// Each sensor has a file of HISTORY_BLOCK_SIZE blocks in time order. A block
+// holds a header and samples of a varint time delta to the previous sample
+// plus the raw pressure and temperature bytes, 3 bytes for readings up to
+// two minutes apart. The headers are the index: a range query binary searches
+// them for the blocks in range and, when there are more blocks than points
+// asked for, reads only every n-th block, so the data read is bounded by the
+// number of points and not by the length of the range.
+class TireHistory {
+private:
+    typedef struct {
+        uint8_t protocol;
+        uint32_t id;
+        uint32_t blockIndex;    // Position of the block in the file
+        bool used;
+        bool dirty;
+        unsigned long dirtySince;
+        unsigned long lastUsed;
+        uint8_t block[HISTORY_BLOCK_SIZE];
+    } CachedBlock;
+
+    typedef struct {
+        uint8_t protocol;
+        uint32_t id;
+        HistoryPoint point;
+    } PendingSample;
+
+    CachedBlock cache[HISTORY_CACHED];
+    PendingSample pending[HISTORY_PENDING];
+    volatile int pendingHead;
+    volatile int pendingTail;
+    portMUX_TYPE lock;
+    bool enabled;
+    uint32_t droppedSamples;
+
+    static void fileName(uint8_t protocol, uint32_t id, char* name, size_t size);
+    CachedBlock* loadBlock(uint8_t protocol, uint32_t id);
+    bool writeBlock(CachedBlock& cached);
+    void append(uint8_t protocol, uint32_t id, const HistoryPoint& point);
+    bool readHeader(File& file, uint32_t index, HistoryHeader& header);
+
+public:
+    TireHistory();
+
+    void begin();
+    bool record(uint8_t protocol, uint32_t id, const HistoryPoint& point);
+    void loop();
+    void flush();
+    int query(uint8_t protocol, uint32_t id, uint32_t from, uint32_t to, HistoryPoint* points, int maxPoints);
+    uint32_t getDroppedSamples() const;
+};
+
+#endif // TIRE_HISTORY_H
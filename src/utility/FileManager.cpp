@@ -3,41 +3,113 @@
 
 bool FileManager::append(String &fileName, uint8_t *byte, size_t size) {
 
-  File f = SD.open(fileName, FILE_WRITE);
+  RecordFileHeader header;
+  IndexHeader index;
 
-  if (f) {
+  if (!recover(fileName))
+    return false;
+
+  File f = openRecords(fileName, size, header, true);
+
+  if (!f) {
+
+    Serial.print("Error opening file"); Serial.print(fileName);
+    return false;
+  }
+
+  File ix;
+
+  if (!beginIndexChange(fileName, ix, index)) {
 
-    uint8_t ret = f.write(byte, size);
     f.close();
+    return false;
+  }
+
+  uint32_t position = header.slots;
+
+  if (header.freeHead != RECORD_END) {
+
+    // The header is written first, a crash leaks the slot instead of handing it out twice
+    uint32_t next;
+
+    position = header.freeHead;
 
-    return (ret == size);
+    if (!readTag(f, header, position, next)) {
+
+      if (ix)
+        ix.close();
+      f.close();
+      return false;
+    }
+
+    header.freeHead = next;
+    header.tombstones--;
+
+    if (!writeHeader(f, header)) {
+
+      if (ix)
+        ix.close();
+      f.close();
+      return false;
+    }
   }
 
-Serial.print("Error opening file"); Serial.print(fileName);
+  uint8_t slot[sizeof(uint32_t) + size];
+  uint32_t tag = RECORD_LIVE;
 
-  return false;
+  memcpy(slot, &tag, sizeof(tag));
+  memcpy(slot + sizeof(tag), byte, size);
+
+  bool ok = f.seek(slotOffset(header, position)) && f.write(slot, sizeof(slot)) == sizeof(slot);
+
+  if (ok && position == header.slots) {
+
+    header.slots++;
+    ok = writeHeader(f, header);
+  }
+
+  // A full index stays out of date and is rebuilt larger by the next lookup
+  if (ix) {
+
+    if (ok && indexInsert(ix, index, hashKey(byte + index.keyOffset, index.keyLength), position))
+      setSynced(ix, index, 1);
+    ix.close();
+  }
+
+  f.close();
+
+  return ok;
 }
 
 void FileManager::deleteFile(String &fileName) {
+
+  String name;
+
+  sidecarName(fileName, ".JNL", name);
+  SD.remove(name);
+  sidecarName(fileName, ".IDX", name);
+  SD.remove(name);
   SD.remove(fileName);
 }
 
-bool FileManager::read(String &fileName, uint8_t position, uint8_t *byte, size_t size) {
+bool FileManager::read(String &fileName, uint32_t position, uint8_t *byte, size_t size) {
+
+  RecordFileHeader header;
+  uint32_t tag;
 
-  File f = SD.open(fileName, FILE_READ);
+  if (!recover(fileName))
+    return false;
+
+  File f = openRecords(fileName, size, header, false);
 
   if (f) {
 
     bool ok;
 
-    ok = f.seek(position * size);
-
-    //    Serial.print("Seek result "); Serial.println(ok);
-    //    Serial.print("Size "); Serial.println(f.size());
-    //    Serial.print("Position "); Serial.println(f.position());
+    ok = readTag(f, header, position, tag) && tag == RECORD_LIVE;
 
     if (ok)
-      ok = f.read(byte, size);
+      ok = f.read(byte, size) == size;
 
     f.close();
 
@@ -47,22 +119,41 @@ bool FileManager::read(String &fileName, uint8_t position, uint8_t *byte, size_t
   return false;
 }
 
-bool FileManager::update(String &fileName, uint8_t position, uint8_t *byte, size_t size) {
-  
-  File f = SD.open(fileName, FILE_WRITE);
+bool FileManager::update(String &fileName, uint32_t position, uint8_t *byte, size_t size) {
+
+  RecordFileHeader header;
+  uint32_t tag;
+
+  if (!recover(fileName))
+    return false;
+
+  File f = openRecords(fileName, size, header, false);
 
   if (f) {
 
     bool ok;
+    IndexHeader index;
+    File ix;
+    uint8_t previous[size];
 
-    ok = f.seek(position * size);
+    ok = readTag(f, header, position, tag) && tag == RECORD_LIVE;
 
-    //    Serial.print("Seek result "); Serial.println(ok);
-    //    Serial.print("Size "); Serial.println(f.size());
-    //    Serial.print("Position "); Serial.println(f.position());
+    // The key may change, the record is read first to find its entry
+    if (ok)
+      ok = f.read(previous, size) == size &&
+           beginIndexChange(fileName, ix, index) &&
+           f.seek(slotOffset(header, position) + sizeof(tag));
 
     if (ok)
-      ok = f.write(byte, size);
+      ok = f.write(byte, size) == size;
+
+    if (ix) {
+
+      if (ok && indexRemove(ix, index, hashKey(previous + index.keyOffset, index.keyLength), position) &&
+          indexInsert(ix, index, hashKey(byte + index.keyOffset, index.keyLength), position))
+        setSynced(ix, index, 1);
+      ix.close();
+    }
 
     f.close();
 
@@ -123,114 +214,865 @@ bool FileManager::copy(String &sourcefileName, String &destinationfileName) {
   return false;
 }
 
-bool FileManager::remove(String &fileName, uint8_t position, size_t size) {
+bool FileManager::remove(String &fileName, uint32_t position, size_t size) {
 
-  File sourceFile = SD.open(fileName, FILE_READ);
-  File tmpFile = SD.open("/tmp.txt", FILE_WRITE);
+  RecordFileHeader header;
+  uint32_t tag;
 
-  if (sourceFile) {
+  if (!recover(fileName))
+    return false;
 
-    if (!tmpFile) {
+  File f = openRecords(fileName, size, header, false);
 
-      sourceFile.close();
-      return false;
+  if (!f)
+    return false;
+
+  if (!readTag(f, header, position, tag) || tag != RECORD_LIVE) {
+
+    f.close();
+    return false;
+  }
+
+  IndexHeader index;
+  File ix;
+  uint8_t record[size];
+
+  if (f.read(record, size) != size || !beginIndexChange(fileName, ix, index)) {
+
+    f.close();
+    return false;
+  }
+
+  uint32_t hash = ix ? hashKey(record + index.keyOffset, index.keyLength) : 0;
+
+  // The slot is tagged first, a crash leaves it out of the free list until the next compaction
+  if (!writeTag(f, header, position, header.freeHead)) {
+
+    if (ix)
+      ix.close();
+    f.close();
+    return false;
+  }
+
+  header.freeHead = position;
+  header.tombstones++;
+
+  bool ok = writeHeader(f, header);
+  bool compacting = header.tombstones * 100 >= header.slots * FILEMANAGER_COMPACT_PERCENT;
+
+  // Compaction moves the records, the index is then rebuilt by the next lookup
+  if (ix) {
+
+    if (ok && !compacting && indexRemove(ix, index, hash, position))
+      setSynced(ix, index, 1);
+    ix.close();
+  }
+
+  if (ok && compacting)
+    ok = compactFrom(f, fileName, header, header.slots, 0, 0, 0);
+
+  f.close();
+
+  return ok;
+}
+
+typedef struct {
+  uint8_t *byte;
+  size_t size;
+  bool (*check)(uint8_t *pRecord, void *pData);
+  void *pData;
+} FindContext;
+
+int FileManager::find(String &fileName, uint8_t *byte, size_t size, bool (*check)(uint8_t *pRecord, void *pData), void *pData) {
+
+  RecordFileHeader header;
+
+  if (!recover(fileName))
+    return -1;
+
+  File f = openRecords(fileName, size, header, false);
+
+  if (f) {
+
+    FindContext context = { byte, size, check, pData };
+    int position = scan(f, header, &findVisit, &context);
+
+    f.close();
+
+    return position;
+  }
+
+  return -1;
+}
+
+bool FileManager::findVisit(uint8_t *pRecord, uint32_t position, void *pData) {
+
+  FindContext *context = (FindContext *)pData;
+
+  memcpy(context->byte, pRecord, context->size);
+
+  return (*context->check)(context->byte, context->pData);
+}
+
+typedef struct {
+  uint8_t *byte;
+  size_t size;
+  const uint8_t *key;
+  uint32_t keyOffset;
+  uint32_t keyLength;
+} KeyContext;
+
+/*
+  First record whose bytes [keyOffset, keyOffset + keyLength) equal key. Uses the index
+  when the file has one for this key, rebuilding it if it is out of date, and scans otherwise.
+*/
+int FileManager::findKey(String &fileName, uint8_t *byte, size_t size, const uint8_t *key, uint32_t keyOffset, uint32_t keyLength) {
+
+  RecordFileHeader header;
+  IndexHeader index;
+
+  if (keyOffset + keyLength > size || !recover(fileName))
+    return -1;
+
+  File f = openRecords(fileName, size, header, false);
+
+  if (!f)
+    return -1;
+
+  File ix = openIndex(fileName, index);
+
+  if (ix && (index.keyOffset != keyOffset || index.keyLength != keyLength)) {
+
+    ix.close();
+    ix = File();
+  }
+
+  if (ix && !index.synced) {
+
+    ix.close();
+    ix = File();
+
+    if (buildIndex(f, header, fileName, keyOffset, keyLength))
+      ix = openIndex(fileName, index);
+  }
+
+  int position;
+
+  if (ix) {
+
+    position = indexLookup(ix, index, f, header, byte, size, key);
+    ix.close();
+  }
+  else {
+
+    KeyContext context = { byte, size, key, keyOffset, keyLength };
+    position = scan(f, header, &keyVisit, &context);
+  }
+
+  f.close();
+
+  return position;
+}
+
+bool FileManager::keyVisit(uint8_t *pRecord, uint32_t position, void *pData) {
+
+  KeyContext *context = (KeyContext *)pData;
+
+  if (memcmp(pRecord + context->keyOffset, context->key, context->keyLength) != 0)
+    return false;
+
+  memcpy(context->byte, pRecord, context->size);
+
+  return true;
+}
+
+bool FileManager::createIndex(String &fileName, size_t size, uint32_t keyOffset, uint32_t keyLength) {
+
+  RecordFileHeader header;
+
+  if (keyOffset + keyLength > size || !recover(fileName))
+    return false;
+
+  File f = openRecords(fileName, size, header, true);
+
+  if (!f)
+    return false;
+
+  bool ok = buildIndex(f, header, fileName, keyOffset, keyLength);
+
+  f.close();
+
+  return ok;
+}
+
+bool FileManager::compact(String &fileName) {
+
+  RecordFileHeader header;
+
+  if (!recover(fileName))
+    return false;
+
+  if (!SD.exists(fileName))
+    return true;
+
+  File f = SD.open(fileName, "r+");
+
+  if (!f)
+    return false;
+
+  if (!readHeader(f, header)) {
+
+    f.close();
+    return false;
+  }
+
+  bool ok = true;
+
+  if (header.tombstones > 0)
+    ok = compactFrom(f, fileName, header, header.slots, 0, 0, 0);
+
+  f.close();
+
+  return ok;
+}
+
+/*
+  Completes a compaction interrupted by a reset. The last complete journal entry is
+  written again, its data never overlaps the slots still to be scanned, and the
+  compaction goes on from there.
+*/
+bool FileManager::recover(String &fileName) {
+
+  String journal;
+  RecordFileHeader header;
+
+  sidecarName(fileName, ".JNL", journal);
+
+  if (!SD.exists(journal))
+    return true;
+
+  File f = SD.open(fileName, "r+");
+
+  if (!f || !readHeader(f, header)) {
+
+    if (f)
+      f.close();
+    return false;
+  }
+
+  File j = SD.open(journal, FILE_READ);
+
+  if (!j) {
+
+    f.close();
+    return false;
+  }
+
+  size_t capacity = blockSlots(header) * slotSize(header);
+  uint8_t *data = new uint8_t[capacity];
+  uint8_t *last = new uint8_t[capacity];
+  JournalEntry entry;
+  JournalEntry lastEntry = { 0 };
+  bool found = false;
+
+  for (int i = 0; i < 2; i++) {
+
+    if (!j.seek(i * (sizeof(entry) + capacity)) ||
+        j.read((uint8_t *)&entry, sizeof(entry)) != sizeof(entry) ||
+        entry.magic != RECORD_MAGIC ||
+        entry.count > blockSlots(header) ||
+        j.read(data, entry.count * slotSize(header)) != entry.count * slotSize(header) ||
+        checksum(entry, data, entry.count * slotSize(header)) != entry.checksum)
+      continue;
+
+    if (!found || entry.sequence > lastEntry.sequence) {
+
+      lastEntry = entry;
+      memcpy(last, data, entry.count * slotSize(header));
+      found = true;
     }
+  }
 
-    uint16_t length = sourceFile.size();
-    uint8_t  buffer[size];
+  j.close();
 
-    //Serial.print("\t\tNumber of records "); Serial.println(length / size);
+  bool ok = true;
 
-    for (int i = 0; i < length / size; i++) {
+  if (found) {
 
-      if (i != position) {
+    // Redo the last step, then continue from the slot after it
+    ok = f.seek(slotOffset(header, lastEntry.destination)) &&
+         f.write(last, lastEntry.count * slotSize(header)) == lastEntry.count * slotSize(header);
 
-        //Serial.print("\t\tWrite record "); Serial.println(i);
+    if (ok)
+      ok = compactFrom(f, fileName, header, lastEntry.slots, lastEntry.source,
+                       lastEntry.destination + lastEntry.count, lastEntry.sequence + 1);
+  }
+  else {
 
-        bool ok = sourceFile.seek(i * size);
+    // Interrupted while writing the first entry, the file was not touched yet
+    SD.remove(journal);
+  }
+
+  delete[] data;
+  delete[] last;
+  f.close();
+
+  return ok;
+}
+
+File FileManager::openRecords(String &fileName, size_t size, RecordFileHeader &header, bool create) {
+
+  if (!SD.exists(fileName)) {
 
-        if (!ok) {
+    if (!create)
+      return File();
 
-          sourceFile.close();
-          tmpFile.close();
-          return false;
-        }
+    File f = SD.open(fileName, FILE_WRITE);
 
-        ok = sourceFile.read(buffer, size);
-        if (!ok) {
+    if (!f)
+      return File();
+
+    header.magic = RECORD_MAGIC;
+    header.recordSize = size;
+    header.slots = 0;
+    header.tombstones = 0;
+    header.freeHead = RECORD_END;
+
+    bool ok = writeHeader(f, header);
+
+    f.close();
+
+    if (!ok)
+      return File();
+  }
 
-          sourceFile.close();
-          tmpFile.close();
-          return false;
-        }
+  File f = SD.open(fileName, "r+");
 
-        ok = tmpFile.write(buffer, size);
-        if (!ok) {
+  if (!f)
+    return File();
 
-          sourceFile.close();
-          tmpFile.close();
-          return false;
-        }
+  if (!readHeader(f, header) || header.recordSize != size) {
+
+    f.close();
+    return File();
+  }
+
+  return f;
+}
+
+bool FileManager::readHeader(File &f, RecordFileHeader &header) {
+
+  return f.seek(0) &&
+         f.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+         header.magic == RECORD_MAGIC;
+}
+
+bool FileManager::writeHeader(File &f, RecordFileHeader &header) {
+
+  return f.seek(0) && f.write((uint8_t *)&header, sizeof(header)) == sizeof(header);
+}
 
+// Leaves the file at the record of the slot
+bool FileManager::readTag(File &f, RecordFileHeader &header, uint32_t position, uint32_t &tag) {
+
+  return position < header.slots &&
+         f.seek(slotOffset(header, position)) &&
+         f.read((uint8_t *)&tag, sizeof(tag)) == sizeof(tag);
+}
+
+bool FileManager::writeTag(File &f, RecordFileHeader &header, uint32_t position, uint32_t tag) {
+
+  return f.seek(slotOffset(header, position)) &&
+         f.write((uint8_t *)&tag, sizeof(tag)) == sizeof(tag);
+}
+
+/*
+  Calls visit with each live record until it returns true, returns that slot or -1.
+  Reads are FILEMANAGER_BLOCK_SIZE bytes on block boundaries, a slot crossing a
+  boundary is carried over to the next block.
+*/
+int FileManager::scan(File &f, RecordFileHeader &header, bool (*visit)(uint8_t *pRecord, uint32_t position, void *pData), void *pData) {
+
+  uint32_t size = slotSize(header);
+  uint32_t end = slotOffset(header, header.slots);
+  uint32_t offset = slotOffset(header, 0);
+  uint32_t start = offset % FILEMANAGER_BLOCK_SIZE;
+  uint32_t available = 0;
+  uint32_t position = 0;
+  uint8_t *buffer = new uint8_t[FILEMANAGER_BLOCK_SIZE + size];
+  int found = -1;
+
+  offset -= start;
+
+  while (found < 0 && position < header.slots) {
+
+    uint32_t length = end - offset;
+
+    if (length > FILEMANAGER_BLOCK_SIZE)
+      length = FILEMANAGER_BLOCK_SIZE;
+
+    if (!f.seek(offset) || f.read(buffer + available, length) != length)
+      break;
+
+    offset += length;
+    available += length;
+
+    while (start + size <= available) {
+
+      uint32_t tag;
+
+      memcpy(&tag, buffer + start, sizeof(tag));
+
+      if (tag == RECORD_LIVE && (*visit)(buffer + start + sizeof(tag), position, pData)) {
+
+        found = position;
+        break;
       }
+
+      start += size;
+      position++;
     }
 
-    //Serial.print("\t\tFinal number of records "); Serial.println(tmpFile.size() / size);
+    memmove(buffer, buffer + start, available - start);
+    available -= start;
+    start = 0;
+  }
 
-    sourceFile.close();
-    tmpFile.flush();
-    tmpFile.close();
+  delete[] buffer;
+
+  return found;
+}
+
+/*
+  Moves the live records of slots [source, slots) down to destination. Every block is
+  journaled before it is written, the header is updated and the journal removed at the end.
+  The index is marked out of date first.
+*/
+bool FileManager::compactFrom(File &f, String &fileName, RecordFileHeader &header, uint32_t slots, uint32_t source, uint32_t destination, uint32_t sequence) {
 
-    deleteFile(fileName);
+  uint32_t size = slotSize(header);
+  uint32_t perBlock = blockSlots(header);
+  size_t capacity = perBlock * size;
+  String journal;
+  IndexHeader index;
+  File ix = openIndex(fileName, index);
 
-    if (!copy("/tmp.txt", fileName))
+  // Slots are about to move
+  if (ix) {
+
+    bool ok = setSynced(ix, index, 0);
+
+    ix.close();
+    if (!ok)
+      return false;
+  }
+
+  sidecarName(fileName, ".JNL", journal);
+
+  if (!SD.exists(journal)) {
+
+    File created = SD.open(journal, FILE_WRITE);
+
+    if (!created)
       return false;
+    created.close();
+  }
+
+  File j = SD.open(journal, "r+");
+
+  if (!j)
+    return false;
+
+  uint8_t *buffer = new uint8_t[capacity];
+  bool ok = true;
+
+  while (ok && source < slots) {
+
+    uint32_t count = slots - source;
+
+    if (count > perBlock)
+      count = perBlock;
+
+    ok = f.seek(slotOffset(header, source)) && f.read(buffer, count * size) == count * size;
+    if (!ok)
+      break;
+
+    uint32_t live = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+
+      uint32_t tag;
+
+      memcpy(&tag, buffer + i * size, sizeof(tag));
+
+      if (tag == RECORD_LIVE) {
+
+        if (live != i)
+          memmove(buffer + live * size, buffer + i * size, size);
+        live++;
+      }
+    }
+
+    // Records already in place are not written again
+    if (live > 0 && (destination != source || live != count)) {
+
+      JournalEntry entry;
+
+      entry.magic = RECORD_MAGIC;
+      entry.sequence = sequence++;
+      entry.destination = destination;
+      entry.source = source + count;
+      entry.count = live;
+      entry.slots = slots;
+      entry.checksum = checksum(entry, buffer, live * size);
+
+      ok = writeJournal(j, entry, buffer, capacity) &&
+           f.seek(slotOffset(header, destination)) &&
+           f.write(buffer, live * size) == live * size;
+      f.flush();
+    }
+
+    source += count;
+    destination += live;
+  }
+
+  delete[] buffer;
+  j.close();
+
+  if (!ok)
+    return false;
+
+  header.slots = destination;
+  header.tombstones = 0;
+  header.freeHead = RECORD_END;
+
+  ok = writeHeader(f, header);
+  f.flush();
+
+  if (ok)
+    SD.remove(journal);
+
+  return ok;
+}
+
+/*
+  Entries alternate between two places, a torn write leaves the previous one valid.
+  The whole buffer is written so that the second place never starts past the end of the file.
+*/
+bool FileManager::writeJournal(File &journal, JournalEntry &entry, uint8_t *data, size_t capacity) {
+
+  bool ok = journal.seek((entry.sequence % 2) * (sizeof(entry) + capacity)) &&
+            journal.write((uint8_t *)&entry, sizeof(entry)) == sizeof(entry) &&
+            journal.write(data, capacity) == capacity;
+
+  journal.flush();
+
+  return ok;
+}
+
+File FileManager::openIndex(String &fileName, IndexHeader &index) {
+
+  String name;
+
+  sidecarName(fileName, ".IDX", name);
+
+  if (!SD.exists(name))
+    return File();
 
-    SD.remove("/tmp.txt");
+  File ix = SD.open(name, "r+");
 
+  if (!ix)
+    return File();
+
+  if (!ix.seek(0) ||
+      ix.read((uint8_t *)&index, sizeof(index)) != sizeof(index) ||
+      index.magic != INDEX_MAGIC) {
+
+    ix.close();
+    return File();
+  }
+
+  return ix;
+}
+
+/*
+  An up to date index is opened in ix and marked out of date until the change is
+  recorded in it. One already out of date is left for the next lookup to rebuild.
+*/
+bool FileManager::beginIndexChange(String &fileName, File &ix, IndexHeader &index) {
+
+  ix = openIndex(fileName, index);
+
+  if (!ix)
+    return true;
+
+  if (!index.synced) {
+
+    ix.close();
+    ix = File();
     return true;
   }
 
+  if (!setSynced(ix, index, 0)) {
+
+    ix.close();
+    ix = File();
+    return false;
+  }
+
+  return true;
+}
+
+typedef struct {
+  FileManager *manager;
+  File *ix;
+  IndexHeader *index;
+  bool ok;
+} IndexContext;
+
+// Sized for twice the slots, so it is at most half full once built
+bool FileManager::buildIndex(File &f, RecordFileHeader &header, String &fileName, uint32_t keyOffset, uint32_t keyLength) {
+
+  String name;
+  IndexHeader index = { INDEX_MAGIC, keyOffset, keyLength, 16, 0, 0, 0 };
+  IndexEntry empty[INDEX_BLOCK_ENTRIES];
+
+  while (index.capacity < 2 * header.slots)
+    index.capacity *= 2;
+
+  sidecarName(fileName, ".IDX", name);
+
+  File ix = SD.open(name, FILE_WRITE);
+
+  if (!ix)
+    return false;
+
+  memset(empty, 0xFF, sizeof(empty));
+
+  bool ok = ix.write((uint8_t *)&index, sizeof(index)) == sizeof(index);
+
+  for (uint32_t i = 0; ok && i < index.capacity; i += INDEX_BLOCK_ENTRIES) {
+
+    uint32_t count = index.capacity - i;
+
+    if (count > INDEX_BLOCK_ENTRIES)
+      count = INDEX_BLOCK_ENTRIES;
+
+    ok = ix.write((uint8_t *)empty, count * sizeof(IndexEntry)) == count * sizeof(IndexEntry);
+  }
+
+  ix.close();
+
+  if (!ok)
+    return false;
+
+  ix = SD.open(name, "r+");
+
+  if (!ix)
+    return false;
+
+  IndexContext context = { this, &ix, &index, true };
+
+  scan(f, header, &indexVisit, &context);
+
+  ok = context.ok && setSynced(ix, index, 1);
+  ix.close();
+
+  return ok;
+}
+
+bool FileManager::indexVisit(uint8_t *pRecord, uint32_t position, void *pData) {
+
+  IndexContext *context = (IndexContext *)pData;
+  IndexHeader *index = context->index;
+
+  context->ok = context->manager->indexInsert(*context->ix, *index,
+                                              hashKey(pRecord + index->keyOffset, index->keyLength), position);
+
+  return !context->ok;
+}
+
+// Writes the header, with the counters changed by insert and remove
+bool FileManager::setSynced(File &ix, IndexHeader &index, uint32_t synced) {
+
+  index.synced = synced;
+
+  bool ok = ix.seek(0) && ix.write((uint8_t *)&index, sizeof(index)) == sizeof(index);
+
+  ix.flush();
+
+  return ok;
+}
+
+bool FileManager::readIndexBlock(File &ix, IndexHeader &index, uint32_t block, IndexEntry *entries) {
+
+  uint32_t count = index.capacity - block * INDEX_BLOCK_ENTRIES;
+
+  if (count > INDEX_BLOCK_ENTRIES)
+    count = INDEX_BLOCK_ENTRIES;
+
+  return ix.seek(sizeof(index) + block * INDEX_BLOCK_ENTRIES * sizeof(IndexEntry)) &&
+         ix.read((uint8_t *)entries, count * sizeof(IndexEntry)) == count * sizeof(IndexEntry);
+}
+
+// False when the table is three quarters full
+bool FileManager::indexInsert(File &ix, IndexHeader &index, uint32_t hash, uint32_t position) {
+
+  IndexEntry entries[INDEX_BLOCK_ENTRIES];
+  uint32_t loaded = INDEX_EMPTY;
+
+  for (uint32_t n = 0; n < index.capacity; n++) {
+
+    uint32_t i = (hash + n) & (index.capacity - 1);
+
+    if (i / INDEX_BLOCK_ENTRIES != loaded) {
+
+      loaded = i / INDEX_BLOCK_ENTRIES;
+      if (!readIndexBlock(ix, index, loaded, entries))
+        return false;
+    }
+
+    IndexEntry &entry = entries[i % INDEX_BLOCK_ENTRIES];
+
+    if (entry.position == INDEX_DELETED)
+      index.deleted--;
+    else if (entry.position != INDEX_EMPTY)
+      continue;
+    else if ((index.used + index.deleted + 1) * 4 > index.capacity * 3)
+      return false;
+
+    entry.hash = hash;
+    entry.position = position;
+    index.used++;
+
+    return ix.seek(sizeof(index) + i * sizeof(IndexEntry)) &&
+           ix.write((uint8_t *)&entry, sizeof(entry)) == sizeof(entry);
+  }
+
   return false;
 }
 
-int FileManager::find(String &fileName, uint8_t *byte, size_t size, bool (*check)(uint8_t *pRecord, void *pData), void *pData) {
+bool FileManager::indexRemove(File &ix, IndexHeader &index, uint32_t hash, uint32_t position) {
 
-  File f = SD.open(fileName, FILE_READ);
+  IndexEntry entries[INDEX_BLOCK_ENTRIES];
+  uint32_t loaded = INDEX_EMPTY;
 
-  if (f) {
+  for (uint32_t n = 0; n < index.capacity; n++) {
 
-    bool ok;
-    uint16_t length = f.size();
+    uint32_t i = (hash + n) & (index.capacity - 1);
 
-    for (int i = 0; i < length / size; i++) {
+    if (i / INDEX_BLOCK_ENTRIES != loaded) {
 
-      ok = f.seek(i * size);
-      if (!ok) {
+      loaded = i / INDEX_BLOCK_ENTRIES;
+      if (!readIndexBlock(ix, index, loaded, entries))
+        return false;
+    }
 
-        f.close();
-        return -1;
-      }
+    IndexEntry &entry = entries[i % INDEX_BLOCK_ENTRIES];
 
-      ok = f.read(byte, size);
-      if (!ok) {
+    if (entry.position == INDEX_EMPTY)
+      return false;
 
-        f.close();
-        return -1;
-      }
+    if (entry.hash != hash || entry.position != position)
+      continue;
 
-      ok = (*check)(byte,pData);
+    entry.position = INDEX_DELETED;
+    index.used--;
+    index.deleted++;
 
-      if (ok) {
+    return ix.seek(sizeof(index) + i * sizeof(IndexEntry)) &&
+           ix.write((uint8_t *)&entry, sizeof(entry)) == sizeof(entry);
+  }
 
-        f.close();
-        return i;
-      }
+  return false;
+}
+
+// Entries with the hash of the key are checked against the record
+int FileManager::indexLookup(File &ix, IndexHeader &index, File &f, RecordFileHeader &header, uint8_t *byte, size_t size, const uint8_t *key) {
+
+  IndexEntry entries[INDEX_BLOCK_ENTRIES];
+  uint32_t loaded = INDEX_EMPTY;
+  uint32_t hash = hashKey(key, index.keyLength);
+
+  for (uint32_t n = 0; n < index.capacity; n++) {
+
+    uint32_t i = (hash + n) & (index.capacity - 1);
+    uint32_t tag;
+
+    if (i / INDEX_BLOCK_ENTRIES != loaded) {
+
+      loaded = i / INDEX_BLOCK_ENTRIES;
+      if (!readIndexBlock(ix, index, loaded, entries))
+        return -1;
     }
 
-    f.close();
+    IndexEntry &entry = entries[i % INDEX_BLOCK_ENTRIES];
+
+    if (entry.position == INDEX_EMPTY)
+      return -1;
+
+    if (entry.position == INDEX_DELETED || entry.hash != hash)
+      continue;
+
+    if (readTag(f, header, entry.position, tag) && tag == RECORD_LIVE &&
+        f.read(byte, size) == size &&
+        memcmp(byte + index.keyOffset, key, index.keyLength) == 0)
+      return entry.position;
   }
 
   return -1;
 }
 
+// Name of a file kept next to a record file, <name>.JNL or <name>.IDX
+void FileManager::sidecarName(String &fileName, const char *extension, String &name) {
+
+  int dot = fileName.lastIndexOf('.');
+  int slash = fileName.lastIndexOf('/');
+
+  name = (dot > slash) ? fileName.substring(0, dot) : fileName;
+  name += extension;
+}
+
+uint32_t FileManager::slotSize(RecordFileHeader &header) {
+
+  return sizeof(uint32_t) + header.recordSize;
+}
+
+uint32_t FileManager::slotOffset(RecordFileHeader &header, uint32_t position) {
+
+  return sizeof(RecordFileHeader) + position * slotSize(header);
+}
+
+// Slots moved per step, at least one for records larger than a block
+uint32_t FileManager::blockSlots(RecordFileHeader &header) {
+
+  uint32_t slots = FILEMANAGER_BLOCK_SIZE / slotSize(header);
+
+  return slots > 0 ? slots : 1;
+}
+
+// FNV-1a
+uint32_t FileManager::checksum(JournalEntry &entry, uint8_t *data, size_t length) {
+
+  uint32_t hash = 2166136261UL;
+  uint8_t *p = (uint8_t *)&entry;
+
+  for (size_t i = 0; i < offsetof(JournalEntry, checksum); i++)
+    hash = (hash ^ p[i]) * 16777619UL;
+
+  for (size_t i = 0; i < length; i++)
+    hash = (hash ^ data[i]) * 16777619UL;
+
+  return hash;
+}
+
+// FNV-1a
+uint32_t FileManager::hashKey(const uint8_t *key, uint32_t length) {
+
+  uint32_t hash = 2166136261UL;
+
+  for (uint32_t i = 0; i < length; i++)
+    hash = (hash ^ key[i]) * 16777619UL;
+
+  return hash;
+}
@@ -4,18 +4,112 @@
 
 #include <SD.h>
 
+#define FILEMANAGER_BLOCK_SIZE       512     // Bytes moved per step while compacting
+#define FILEMANAGER_COMPACT_PERCENT  25      // Compact once this share of the slots is removed
+
+/*
+  Record files
+
+  A header is followed by fixed size slots. Each slot starts with a tag, RECORD_LIVE
+  for a record or, for a removed slot, the next free slot. Removed slots are chained
+  in a free list and reused by append(), so removing a record writes a few bytes.
+
+  When too many slots are free the live records are moved down in place, one block
+  at a time. Each block is first written to a journal (<name>.JNL) with two
+  alternating entries, so an interrupted compaction is completed by recover().
+
+  Scans read FILEMANAGER_BLOCK_SIZE aligned blocks. A file can also get an index
+  (<name>.IDX) by createIndex(), a hash table from a key inside the record to its
+  slot, kept up to date by the calls changing the file and used by findKey().
+  The index is marked out of date while the records change and rebuilt by the
+  next lookup if a change did not complete.
+*/
+
+#define RECORD_MAGIC   0x46434552    // "RECF"
+#define RECORD_LIVE    0xFFFFFFFF    // Slot tag of a record
+#define RECORD_END     0xFFFFFFFE    // End of the free list
+
+typedef struct {
+  uint32_t magic;
+  uint32_t recordSize;
+  uint32_t slots;           // Slots in use, live or free
+  uint32_t tombstones;      // Free slots
+  uint32_t freeHead;        // First free slot or RECORD_END
+} RecordFileHeader;
+
+#define INDEX_MAGIC          0x58444952    // "RIDX"
+#define INDEX_EMPTY          0xFFFFFFFF    // Entry never used
+#define INDEX_DELETED        0xFFFFFFFE    // Entry of a removed record
+#define INDEX_BLOCK_ENTRIES  64            // Entries read at a time while probing
+
+typedef struct {
+  uint32_t magic;
+  uint32_t keyOffset;       // Key position in the record
+  uint32_t keyLength;
+  uint32_t capacity;        // Entries, a power of two
+  uint32_t used;            // Entries of records
+  uint32_t deleted;         // Entries of removed records
+  uint32_t synced;          // 0 while the records are being changed
+} IndexHeader;
+
+typedef struct {
+  uint32_t hash;
+  uint32_t position;        // Slot, INDEX_EMPTY or INDEX_DELETED
+} IndexEntry;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t sequence;        // Step of the compaction, the highest valid entry is the last one
+  uint32_t destination;     // First slot written by the step
+  uint32_t source;          // Next slot to scan after the step
+  uint32_t count;           // Slots in the data following the entry
+  uint32_t slots;           // Slots before compaction
+  uint32_t checksum;        // Of the fields above and the data
+} JournalEntry;
+
 class FileManager {
 
   public:
     void deleteFile(String &fileName);
     bool append(String &fileName, uint8_t *byte, size_t size);
-    bool read(String &fileName, uint8_t position, uint8_t *byte, size_t size);
-    bool update(String &fileName, uint8_t position, uint8_t *byte, size_t size);
+    bool read(String &fileName, uint32_t position, uint8_t *byte, size_t size);
+    bool update(String &fileName, uint32_t position, uint8_t *byte, size_t size);
     bool copy(String &sourcefileName, String &destinationfileName);
     bool copy(const char *sourcefileName, String &destinationfileName);
     bool copy(String &sourcefileName, const char *destinationfileName);
-    bool remove(String &fileName, uint8_t position, size_t size);
+    bool remove(String &fileName, uint32_t position, size_t size);
     int find(String &fileName, uint8_t *byte, size_t size, bool (*check)(uint8_t *pRecord, void *pData), void *pData);
+    int findKey(String &fileName, uint8_t *byte, size_t size, const uint8_t *key, uint32_t keyOffset, uint32_t keyLength);
+    bool createIndex(String &fileName, size_t size, uint32_t keyOffset, uint32_t keyLength);
+    bool compact(String &fileName);
+    bool recover(String &fileName);
+
+  private:
+    File openRecords(String &fileName, size_t size, RecordFileHeader &header, bool create);
+    bool readHeader(File &f, RecordFileHeader &header);
+    bool writeHeader(File &f, RecordFileHeader &header);
+    bool readTag(File &f, RecordFileHeader &header, uint32_t position, uint32_t &tag);
+    bool writeTag(File &f, RecordFileHeader &header, uint32_t position, uint32_t tag);
+    int scan(File &f, RecordFileHeader &header, bool (*visit)(uint8_t *pRecord, uint32_t position, void *pData), void *pData);
+    bool compactFrom(File &f, String &fileName, RecordFileHeader &header, uint32_t slots, uint32_t source, uint32_t destination, uint32_t sequence);
+    bool writeJournal(File &journal, JournalEntry &entry, uint8_t *data, size_t capacity);
+    File openIndex(String &fileName, IndexHeader &index);
+    bool beginIndexChange(String &fileName, File &ix, IndexHeader &index);
+    bool buildIndex(File &f, RecordFileHeader &header, String &fileName, uint32_t keyOffset, uint32_t keyLength);
+    bool setSynced(File &ix, IndexHeader &index, uint32_t synced);
+    bool readIndexBlock(File &ix, IndexHeader &index, uint32_t block, IndexEntry *entries);
+    bool indexInsert(File &ix, IndexHeader &index, uint32_t hash, uint32_t position);
+    bool indexRemove(File &ix, IndexHeader &index, uint32_t hash, uint32_t position);
+    int indexLookup(File &ix, IndexHeader &index, File &f, RecordFileHeader &header, uint8_t *byte, size_t size, const uint8_t *key);
+    void sidecarName(String &fileName, const char *extension, String &name);
+    uint32_t slotSize(RecordFileHeader &header);
+    uint32_t slotOffset(RecordFileHeader &header, uint32_t position);
+    uint32_t blockSlots(RecordFileHeader &header);
+    uint32_t checksum(JournalEntry &entry, uint8_t *data, size_t length);
+    static uint32_t hashKey(const uint8_t *key, uint32_t length);
+    static bool findVisit(uint8_t *pRecord, uint32_t position, void *pData);
+    static bool keyVisit(uint8_t *pRecord, uint32_t position, void *pData);
+    static bool indexVisit(uint8_t *pRecord, uint32_t position, void *pData);
 };
 
 #endif